@@ -0,0 +1,419 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <ucset/allocators.hpp>
+#include <ucset/arena.hpp>
+#include <ucset/columns.hpp>
+#include <ucset/consistent_avl.hpp>
+#include <ucset/consistent_set.hpp>
+#include <ucset/front_coded.hpp>
+#include <ucset/varlen.hpp>
+
+using namespace unum::ucset;
+
+struct pair_t {
+    std::size_t key;
+    std::size_t value;
+
+    pair_t(std::size_t key = 0, std::size_t value = 0) noexcept : key(key), value(value) {}
+    explicit operator std::size_t() const noexcept { return key; }
+    operator bool() const noexcept { return key != -1; }
+};
+
+struct pair_compare_t {
+    using value_type = std::size_t;
+    bool operator()(pair_t a, pair_t b) const noexcept { return a.key < b.key; }
+    bool operator()(std::size_t a, pair_t b) const noexcept { return a < b.key; }
+    bool operator()(pair_t a, std::size_t b) const noexcept { return a.key < b; }
+};
+
+/// Trivially copyable element of @p bytes_ak bytes, where the key is followed by a payload.
+template <std::size_t bytes_ak>
+struct wide_pair_gt {
+    std::size_t key = 0;
+    std::uint8_t payload[bytes_ak - sizeof(std::size_t)] {};
+
+    wide_pair_gt(std::size_t key = 0) noexcept : key(key) {}
+    explicit operator std::size_t() const noexcept { return key; }
+    operator bool() const noexcept { return key != -1; }
+};
+
+template <std::size_t bytes_ak>
+struct wide_compare_gt {
+    using value_type = std::size_t;
+    using pair_t = wide_pair_gt<bytes_ak>;
+    bool operator()(pair_t const& a, pair_t const& b) const noexcept { return a.key < b.key; }
+    bool operator()(std::size_t a, pair_t const& b) const noexcept { return a < b.key; }
+    bool operator()(pair_t const& a, std::size_t b) const noexcept { return a.key < b; }
+};
+
+using allocator_t = counting_allocator_gt<>;
+using stl_t = consistent_set_gt<pair_t, pair_compare_t, allocator_t>;
+using avl_t = consistent_avl_gt<pair_t, pair_compare_t, allocator_t>;
+using compact_stl_t = consistent_set_gt<pair_t, pair_compare_t, allocator_t, no_tracer_t, compact_layout_t>;
+using compact_avl_t = consistent_avl_gt<pair_t, pair_compare_t, allocator_t, no_tracer_t, compact_layout_t>;
+using arena_avl_t = consistent_avl_gt<pair_t, pair_compare_t, arena_allocator_gt<>, no_tracer_t, compact_layout_t>;
+using offset_avl_t =
+    consistent_avl_gt<pair_t, pair_compare_t, arena_allocator_gt<>, no_tracer_t, compact_layout_t, offset_links_t>;
+
+constexpr std::size_t elements_k = 1ul << 16;
+constexpr std::size_t batch_k = 1ul << 10;
+constexpr std::size_t batches_k = 256;
+
+static double allocations_per(allocation_stats_t const& stats, std::size_t operations) {
+    return double(stats.allocations) / operations;
+}
+
+static double bytes_per(allocation_stats_t const& stats, std::size_t operations) {
+    return double(stats.allocated_bytes) / operations;
+}
+
+static void report(char const* engine, char const* site, std::size_t operations) {
+    auto stats = allocator_t::counters().stats(site);
+    std::printf("%-4s %-20s %10.2f allocs/op %12.1f bytes/op\n",
+                engine,
+                site,
+                allocations_per(stats, operations),
+                bytes_per(stats, operations));
+}
+
+template <typename collection_at>
+void bench_allocations(char const* engine) {
+    allocator_t::counters().reset();
+    auto collection = *collection_at::make();
+
+    {
+        allocation_site_t _ {"upsert"};
+        for (std::size_t key = 0; key != elements_k; ++key)
+            if (!collection.upsert(pair_t {key, key}))
+                std::printf("upsert failed\n");
+    }
+    report(engine, "upsert", elements_k);
+
+    {
+        allocation_site_t _ {"overwrite"};
+        for (std::size_t key = 0; key != elements_k; ++key)
+            if (!collection.upsert(pair_t {key, key + 1}))
+                std::printf("overwrite failed\n");
+    }
+    report(engine, "overwrite", elements_k);
+
+    std::size_t const transactions = elements_k / 16;
+    for (std::size_t idx = 0; idx != transactions; ++idx) {
+        std::optional<typename collection_at::transaction_t> txn;
+        {
+            allocation_site_t _ {"transaction"};
+            txn = collection.transaction();
+            if (!txn || !txn->watch(idx) || !txn->upsert(pair_t {idx, idx + 1}))
+                std::printf("transaction failed\n");
+        }
+        {
+            allocation_site_t _ {"stage"};
+            if (!txn->stage())
+                std::printf("stage failed\n");
+        }
+        {
+            allocation_site_t _ {"commit"};
+            if (!txn->commit())
+                std::printf("commit failed\n");
+        }
+    }
+    report(engine, "transaction", transactions);
+    report(engine, "stage", transactions);
+    report(engine, "commit", transactions);
+}
+
+/**
+ * Compares successful batch upserts with batches, that fail halfway
+ * due to an injected allocation failure and have to roll back.
+ */
+template <typename collection_at>
+void bench_batch_rollback(char const* engine) {
+    allocator_t::counters().reset();
+    auto collection = *collection_at::make();
+    std::vector<pair_t> batch(batch_k);
+
+    auto measure = [&](bool fail) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t idx = 0; idx != batches_k; ++idx) {
+            for (std::size_t offset = 0; offset != batch_k; ++offset)
+                batch[offset] = pair_t {idx * batch_k + offset, offset};
+            if (fail)
+                allocator_t::counters().fail_nth(batch_k / 2);
+            auto status = collection.upsert(batch.begin(), batch.end());
+            if (fail == static_cast<bool>(status))
+                std::printf("unexpected batch status\n");
+            allocator_t::counters().fail_nth(0);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / double(batches_k * batch_k);
+    };
+
+    double committed = measure(false);
+    double rolled_back = measure(true);
+    std::printf("%-4s %-20s %10.2f ns/element\n", engine, "batch committed", committed);
+    std::printf("%-4s %-20s %10.2f ns/element\n", engine, "batch rolled back", rolled_back);
+}
+
+/**
+ * Measures batch upserts and reservoir sampling of trivially copyable elements
+ * of different sizes, which are copied into the nodes bytewise.
+ */
+template <template <typename, typename> class engine_at, std::size_t bytes_ak>
+void bench_element_size(char const* engine) {
+    using pair_t = wide_pair_gt<bytes_ak>;
+    using collection_t = engine_at<pair_t, wide_compare_gt<bytes_ak>>;
+    static_assert(std::is_trivially_copyable<pair_t>() && sizeof(pair_t) == bytes_ak);
+    auto collection = *collection_t::make();
+    std::vector<pair_t> batch(batch_k);
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t idx = 0; idx != batches_k; ++idx) {
+        for (std::size_t offset = 0; offset != batch_k; ++offset)
+            batch[offset] = pair_t {idx * batch_k + offset};
+        if (!collection.upsert(batch.begin(), batch.end()))
+            std::printf("batch upsert failed\n");
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double upsert = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / double(batches_k * batch_k);
+
+    std::mt19937_64 generator {42};
+    std::size_t seen = 0;
+    start = std::chrono::steady_clock::now();
+    if (!collection.sample_range(std::size_t(0), batches_k * batch_k, generator, seen, batch_k, batch.begin()))
+        std::printf("sampling failed\n");
+    elapsed = std::chrono::steady_clock::now() - start;
+    double sample = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / double(seen);
+
+    char site[32];
+    std::snprintf(site, sizeof(site), "batch of %zu B", bytes_ak);
+    std::printf("%-4s %-20s %10.2f ns/element %9.2f ns/sample\n", engine, site, upsert, sample);
+}
+
+template <typename element_at, typename comparator_at>
+using default_stl_t = consistent_set_gt<element_at, comparator_at>;
+template <typename element_at, typename comparator_at>
+using default_avl_t = consistent_avl_gt<element_at, comparator_at>;
+
+/**
+ * Compares the memory footprint and random lookup speed of AVL trees
+ * with 64-bit pointers and 32-bit offsets, both in a contiguous arena.
+ */
+template <typename collection_at>
+void bench_links(char const* engine, std::size_t elements) {
+    arena_config_t config;
+    config.region_bytes = 1ul << 20;
+    config.contiguous_bytes = 1ul << 34;
+    arena_t arena {config};
+    auto collection = *collection_at::make(arena);
+
+    std::vector<std::size_t> keys(elements);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64 {42});
+    for (std::size_t key : keys)
+        if (!collection.upsert(pair_t {key, key}))
+            std::printf("upsert failed\n");
+
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64 {7});
+    std::size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t key : keys)
+        if (!collection.find(key, [&](pair_t const& pair) noexcept { checksum += pair.value; }))
+            std::printf("find failed\n");
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double lookup = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / double(elements);
+
+    std::printf("%-4s %-20s %10.1f MiB %9.2f ns/find %12zu checksum\n",
+                engine,
+                "links",
+                arena.mapped_bytes() / double(1ul << 20),
+                lookup,
+                checksum);
+}
+
+struct urls_tag_t {};
+using urls_allocator_t = counting_allocator_gt<std::allocator<std::uint8_t>, urls_tag_t>;
+using url_record_t = varlen_gt<32, counting_allocator_gt<std::allocator<char>, urls_tag_t>>;
+using urls_avl_t = consistent_avl_gt<url_record_t, varlen_compare_t, urls_allocator_t>;
+using urls_blocks_t = front_coded_gt<urls_allocator_t>;
+
+/**
+ * Compares the memory footprint and random lookup speed of URL-like keys
+ * stored one per node, and front-coded in blocks.
+ */
+template <typename collection_at>
+void bench_urls(char const* engine, std::size_t elements) {
+    auto& counters = urls_allocator_t::counters();
+    std::size_t const live_before = counters.live_bytes();
+    std::vector<url_record_t> records;
+    records.reserve(elements);
+    for (std::size_t idx = 0; idx != elements; ++idx)
+        records.emplace_back("https://example.com/catalog/" + std::to_string(idx % 64) + "/items/" + std::to_string(idx),
+                             std::to_string(idx * 7));
+
+    auto collection = *collection_at::make();
+    if constexpr (std::is_same<collection_at, urls_avl_t>()) {
+        for (auto& record : records)
+            if (!collection.upsert(std::move(record)))
+                std::printf("upsert failed\n");
+    }
+    else if (!collection.upsert(records.begin(), records.end()))
+        std::printf("upsert failed\n");
+    // The AVL owns the spilled bytes of the moved records, the blocks own copies.
+    records.clear();
+    std::size_t const live_stored = counters.live_bytes();
+
+    std::vector<std::string> keys;
+    for (std::size_t idx = 0; idx != elements; ++idx)
+        keys.push_back("https://example.com/catalog/" + std::to_string(idx % 64) + "/items/" + std::to_string(idx));
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64 {7});
+    std::size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto const& key : keys)
+        if (!collection.find(std::string_view(key), [&](typename collection_at::element_t const& record) noexcept {
+                checksum += record.value().size();
+            }))
+            std::printf("find failed\n");
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double lookup = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / double(elements);
+
+    std::printf("%-4s %-20s %10.1f MiB %9.2f ns/find %12zu checksum\n",
+                engine,
+                "urls",
+                (live_stored - live_before) / double(1ul << 20),
+                lookup,
+                checksum);
+}
+
+/**
+ * Compares repeated analytical filters, evaluated in `range` callbacks
+ * over the tree, and over a columnar copy, exported once.
+ */
+template <typename collection_at>
+void bench_scans(char const* engine, std::size_t elements) {
+    constexpr std::size_t scans_k = 16;
+    auto collection = *collection_at::make();
+    std::mt19937_64 generator {42};
+    for (std::size_t key = 0; key != elements; ++key)
+        if (!collection.upsert(pair_t {key, generator() % 1000}))
+            std::printf("upsert failed\n");
+
+    auto seconds_since = [](auto start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    std::size_t tree_matches = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t scan = 0; scan != scans_k; ++scan)
+        if (!collection.range(std::size_t(0), elements, [&](pair_t const& pair) noexcept {
+                tree_matches += pair.value >= scan * 10 && pair.value <= scan * 10 + 99;
+            }))
+            std::printf("range failed\n");
+    double tree = seconds_since(start);
+
+    columns_gt<std::size_t, std::size_t> columns;
+    start = std::chrono::steady_clock::now();
+    if (!columns.export_range(collection, std::size_t(0), elements, &pair_t::value))
+        std::printf("export failed\n");
+    double exported = seconds_since(start);
+
+    std::size_t column_matches = 0;
+    decltype(columns)::positions_t positions;
+    start = std::chrono::steady_clock::now();
+    for (std::size_t scan = 0; scan != scans_k; ++scan) {
+        positions.clear();
+        if (!columns.scan_filter<0>(between_gt<std::size_t> {scan * 10, scan * 10 + 99}, positions))
+            std::printf("scan failed\n");
+        column_matches += positions.size();
+    }
+    double scanned = seconds_since(start);
+
+    std::printf("%-4s %-20s %10.2f ms/scan %9.2f ms/scan %9.2f ms/export %6s\n",
+                engine,
+                "scans",
+                tree * 1e3 / scans_k,
+                scanned * 1e3 / scans_k,
+                exported * 1e3,
+                tree_matches == column_matches ? "match" : "differ");
+}
+
+/**
+ * Measures how random insertions and deletions scatter AVL nodes across the arena,
+ * and how full scans recover, once the tree is defragmented in bounded steps.
+ */
+template <typename collection_at>
+void bench_defragment(char const* engine, std::size_t elements) {
+    constexpr std::size_t step_k = 4096;
+    arena_config_t config;
+    config.region_bytes = 1ul << 20;
+    arena_t arena {config};
+    auto collection = *collection_at::make(arena);
+
+    std::mt19937_64 generator {42};
+    for (std::size_t idx = 0; idx != elements * 2; ++idx) {
+        std::size_t key = generator() % elements;
+        bool inserted = idx % 3 ? collection.upsert(pair_t {key, key}) : collection.erase_range(key, key + 1, no_op_t {});
+        if (!inserted)
+            std::printf("modification failed\n");
+    }
+
+    auto scan = [&] {
+        std::size_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        if (!collection.range(std::size_t(0), elements, [&](pair_t const& pair) noexcept { checksum += pair.value; }))
+            std::printf("range failed\n");
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    std::size_t scattered = collection.neighbor_distance();
+    double before = scan();
+    double longest_step = 0;
+    for (std::size_t steps = 0; steps <= collection.size() / step_k; ++steps) {
+        auto start = std::chrono::steady_clock::now();
+        if (!collection.defragment(step_k))
+            std::printf("defragment failed\n");
+        longest_step = std::max(longest_step,
+                                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    double after = scan();
+
+    std::printf("%-4s %-20s %10.2f ms/scan %9.2f ms/scan %9.2f ms/step %6zu -> %zu B/neighbor\n",
+                engine,
+                "defragment",
+                before * 1e3,
+                after * 1e3,
+                longest_step * 1e3,
+                scattered,
+                collection.neighbor_distance());
+}
+
+int main(int argc, char** argv) {
+    // Large trees take a while to build, so the default stays small, but `100000000` can be passed.
+    std::size_t const link_elements = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1ul << 22;
+
+    bench_allocations<stl_t>("stl");
+    bench_allocations<avl_t>("avl");
+    bench_allocations<compact_stl_t>("stl*");
+    bench_allocations<compact_avl_t>("avl*");
+    bench_batch_rollback<stl_t>("stl");
+    bench_batch_rollback<avl_t>("avl");
+    bench_element_size<default_stl_t, 16>("stl");
+    bench_element_size<default_stl_t, 64>("stl");
+    bench_element_size<default_stl_t, 256>("stl");
+    bench_element_size<default_avl_t, 16>("avl");
+    bench_element_size<default_avl_t, 64>("avl");
+    bench_element_size<default_avl_t, 256>("avl");
+    bench_links<arena_avl_t>("avl*", link_elements);
+    bench_links<offset_avl_t>("avl+", link_elements);
+    bench_urls<urls_avl_t>("avl", link_elements / 4);
+    bench_urls<urls_blocks_t>("fc", link_elements / 4);
+    bench_scans<default_stl_t<pair_t, pair_compare_t>>("stl", link_elements / 4);
+    bench_scans<default_avl_t<pair_t, pair_compare_t>>("avl", link_elements / 4);
+    bench_defragment<arena_avl_t>("avl*", link_elements / 4);
+    return 0;
+}
@@ -0,0 +1,363 @@
+#pragma once
+#include <array>       // `std::array` for allocation sites
+#include <atomic>      // `std::atomic` for shared counters
+#include <limits>      // `std::numeric_limits`
+#include <memory>      // `std::allocator_traits`
+#include <type_traits> // `std::true_type`
+#include <utility>     // `std::exchange`
+
+#include "status.hpp"
+
+namespace unum::ucset {
+
+/**
+ * @brief Snapshot of allocation counters for one or all allocation sites.
+ */
+struct allocation_stats_t {
+    std::size_t allocations {0};
+    std::size_t deallocations {0};
+    std::size_t allocated_bytes {0};
+    std::size_t deallocated_bytes {0};
+    std::size_t failures {0};
+
+    std::size_t live_bytes() const noexcept { return allocated_bytes - deallocated_bytes; }
+    allocation_stats_t operator-(allocation_stats_t const& older) const noexcept {
+        return {
+            allocations - older.allocations,
+            deallocations - older.deallocations,
+            allocated_bytes - older.allocated_bytes,
+            deallocated_bytes - older.deallocated_bytes,
+            failures - older.failures,
+        };
+    }
+};
+
+/**
+ * @brief Labels all the allocations, that the current thread performs
+ * within a scope, so they can be attributed to a specific call site.
+ * Sites nest, the innermost wins. Names must outlive the counters,
+ * so string literals are the best choice.
+ */
+class allocation_site_t {
+    char const* previous_;
+
+  public:
+    explicit allocation_site_t(char const* name) noexcept : previous_(std::exchange(current(), name)) {}
+    ~allocation_site_t() noexcept { current() = previous_; }
+    allocation_site_t(allocation_site_t const&) = delete;
+    allocation_site_t& operator=(allocation_site_t const&) = delete;
+
+    static char const*& current() noexcept {
+        thread_local char const* name = nullptr;
+        return name;
+    }
+};
+
+/**
+ * @brief Shared state of all the @c `counting_allocator_gt` instances with the same tag.
+ * Counts allocations per site and can inject failures:
+ * > into the Nth allocation from now, to test partial failures of batches.
+ * > into every allocation exceeding a budget of live bytes.
+ */
+class allocation_counters_t {
+  public:
+    static constexpr std::size_t sites_k = 32;
+    static constexpr std::size_t unlimited_k = std::numeric_limits<std::size_t>::max();
+
+  private:
+    struct site_t {
+        std::atomic<char const*> name {nullptr};
+        std::atomic<std::size_t> allocations {0};
+        std::atomic<std::size_t> deallocations {0};
+        std::atomic<std::size_t> allocated_bytes {0};
+        std::atomic<std::size_t> deallocated_bytes {0};
+        std::atomic<std::size_t> failures {0};
+    };
+
+    /// The first site collects the unlabeled allocations and the overflow.
+    std::array<site_t, sites_k> sites_;
+    std::atomic<std::size_t> live_bytes_ {0};
+    std::atomic<std::size_t> countdown_ {0};
+    std::atomic<std::size_t> budget_ {unlimited_k};
+
+    site_t& site(char const* name) noexcept {
+        if (!name)
+            return sites_[0];
+        for (std::size_t idx = 1; idx != sites_k; ++idx) {
+            char const* expected = nullptr;
+            if (sites_[idx].name.compare_exchange_strong(expected, name) || expected == name)
+                return sites_[idx];
+        }
+        return sites_[0];
+    }
+
+    static allocation_stats_t snapshot(site_t const& site) noexcept {
+        return {
+            site.allocations.load(),
+            site.deallocations.load(),
+            site.allocated_bytes.load(),
+            site.deallocated_bytes.load(),
+            site.failures.load(),
+        };
+    }
+
+  public:
+    /**
+     * @return True, if the allocation must proceed, false if a failure must be injected.
+     */
+    bool allocate(std::size_t bytes) noexcept {
+        auto& site = this->site(allocation_site_t::current());
+        std::size_t countdown = countdown_.load();
+        bool fail_now = countdown && countdown_.compare_exchange_strong(countdown, countdown - 1) && countdown == 1;
+        bool fail_budget = live_bytes_.load() + bytes > budget_.load();
+        if (fail_now || fail_budget) {
+            ++site.failures;
+            return false;
+        }
+        ++site.allocations;
+        site.allocated_bytes += bytes;
+        live_bytes_ += bytes;
+        return true;
+    }
+
+    void deallocate(std::size_t bytes) noexcept {
+        auto& site = this->site(allocation_site_t::current());
+        ++site.deallocations;
+        site.deallocated_bytes += bytes;
+        live_bytes_ -= bytes;
+    }
+
+    /**
+     * @brief Makes the @p nth allocation from now fail. Zero disarms.
+     */
+    void fail_nth(std::size_t nth) noexcept { countdown_ = nth; }
+
+    /**
+     * @brief Makes every allocation fail, if the live bytes would exceed the @p budget.
+     */
+    void fail_above(std::size_t budget) noexcept { budget_ = budget; }
+
+    std::size_t live_bytes() const noexcept { return live_bytes_.load(); }
+
+    allocation_stats_t stats(char const* name) noexcept { return snapshot(site(name)); }
+
+    allocation_stats_t total() const noexcept {
+        allocation_stats_t result;
+        for (auto const& site : sites_) {
+            auto stats = snapshot(site);
+            result.allocations += stats.allocations;
+            result.deallocations += stats.deallocations;
+            result.allocated_bytes += stats.allocated_bytes;
+            result.deallocated_bytes += stats.deallocated_bytes;
+            result.failures += stats.failures;
+        }
+        return result;
+    }
+
+    /**
+     * @brief Disarms the failures and forgets the site names, but not the live bytes.
+     */
+    void reset() noexcept {
+        for (auto& site : sites_) {
+            site.name = nullptr;
+            site.allocations = 0;
+            site.deallocations = 0;
+            site.allocated_bytes = 0;
+            site.deallocated_bytes = 0;
+            site.failures = 0;
+        }
+        countdown_ = 0;
+        budget_ = unlimited_k;
+    }
+};
+
+/**
+ * @brief Returns the counters shared by all the allocators with the same @p tag_at.
+ */
+template <typename tag_at>
+allocation_counters_t& shared_allocation_counters() noexcept {
+    static allocation_counters_t counters;
+    return counters;
+}
+
+/**
+ * @brief Wraps any STL-compatible allocator, counting allocations and bytes
+ * per @c `allocation_site_t`, and injecting `std::bad_alloc` failures on demand.
+ * Every container of the library reports those failures as `out_of_memory_heap_k`.
+ *
+ * @tparam tag_at   All the allocators with the same tag share their counters,
+ *                  independent of the type they are rebound to.
+ */
+template <typename allocator_at = std::allocator<std::uint8_t>, typename tag_at = void>
+class counting_allocator_gt : public allocator_at {
+    using traits_t = std::allocator_traits<allocator_at>;
+
+  public:
+    using value_type = typename traits_t::value_type;
+    using allocator_t = allocator_at;
+
+    template <typename other_at>
+    struct rebind {
+        using other = counting_allocator_gt<typename traits_t::template rebind_alloc<other_at>, tag_at>;
+    };
+
+    counting_allocator_gt() = default;
+    counting_allocator_gt(allocator_t const& allocator) noexcept : allocator_t(allocator) {}
+    template <typename other_at>
+    counting_allocator_gt(counting_allocator_gt<other_at, tag_at> const& other) noexcept
+        : allocator_t(other.inner()) {}
+
+    allocator_t const& inner() const noexcept { return *this; }
+
+    static allocation_counters_t& counters() noexcept { return shared_allocation_counters<tag_at>(); }
+
+    value_type* allocate(std::size_t n) {
+        if (!counters().allocate(n * sizeof(value_type)))
+            throw std::bad_alloc();
+        try {
+            return traits_t::allocate(*this, n);
+        }
+        catch (...) {
+            counters().deallocate(n * sizeof(value_type));
+            throw;
+        }
+    }
+
+    void deallocate(value_type* pointer, std::size_t n) noexcept {
+        counters().deallocate(n * sizeof(value_type));
+        traits_t::deallocate(*this, pointer, n);
+    }
+
+    template <typename other_at>
+    bool operator==(counting_allocator_gt<other_at, tag_at> const& other) const noexcept {
+        return inner() == other.inner();
+    }
+    template <typename other_at>
+    bool operator!=(counting_allocator_gt<other_at, tag_at> const& other) const noexcept {
+        return inner() != other.inner();
+    }
+};
+
+/**
+ * @brief Byte budget of a single container, shared by all of its allocators.
+ * Bytes are reserved before touching the underlying allocator, so going
+ * over budget never reaches the global heap.
+ */
+class memory_budget_t {
+  public:
+    static constexpr std::size_t unlimited_k = std::numeric_limits<std::size_t>::max();
+
+  private:
+    std::atomic<std::size_t> limit_ {unlimited_k};
+    std::atomic<std::size_t> usage_ {0};
+    /// Budget of the enclosing container, that every allocation is also charged to.
+    memory_budget_t* shared_ {nullptr};
+
+  public:
+    memory_budget_t() = default;
+    memory_budget_t(memory_budget_t const&) = delete;
+    memory_budget_t& operator=(memory_budget_t const&) = delete;
+
+    [[nodiscard]] bool acquire(std::size_t bytes) noexcept {
+        if (shared_ && !shared_->acquire(bytes))
+            return false;
+        std::size_t usage = usage_.load(std::memory_order_relaxed);
+        do {
+            if (usage + bytes > limit_.load(std::memory_order_relaxed)) {
+                if (shared_)
+                    shared_->release(bytes);
+                return false;
+            }
+        } while (!usage_.compare_exchange_weak(usage, usage + bytes, std::memory_order_relaxed));
+        return true;
+    }
+
+    void release(std::size_t bytes) noexcept {
+        usage_.fetch_sub(bytes, std::memory_order_relaxed);
+        if (shared_)
+            shared_->release(bytes);
+    }
+
+    /**
+     * @brief Charges the current and all the following allocations to the @p shared budget as well,
+     * so that parts of a `partitioned_gt` draw from one limit, however unevenly they fill up.
+     */
+    void share(memory_budget_t& shared) noexcept {
+        shared.usage_.fetch_add(usage(), std::memory_order_relaxed);
+        shared_ = &shared;
+    }
+
+    /**
+     * @brief Changes the limit at runtime. Lowering it below the current
+     * usage doesn't evict anything, but fails all the following allocations.
+     */
+    void limit(std::size_t bytes) noexcept { limit_.store(bytes, std::memory_order_relaxed); }
+    std::size_t limit() const noexcept { return limit_.load(std::memory_order_relaxed); }
+    std::size_t usage() const noexcept { return usage_.load(std::memory_order_relaxed); }
+    bool exhausted() const noexcept { return usage() >= limit() || (shared_ && shared_->exhausted()); }
+};
+
+/**
+ * @brief Wraps any STL-compatible allocator, charging every allocation
+ * to a @c `memory_budget_t` and throwing @c `out_of_budget_t` once it's exceeded.
+ * Default-constructed instances have no budget and are unlimited.
+ */
+template <typename allocator_at>
+class budgeted_allocator_gt : public allocator_at {
+    using traits_t = std::allocator_traits<allocator_at>;
+
+    memory_budget_t* budget_ {nullptr};
+
+  public:
+    using value_type = typename traits_t::value_type;
+    using allocator_t = allocator_at;
+    using is_always_equal = std::false_type;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename other_at>
+    struct rebind {
+        using other = budgeted_allocator_gt<typename traits_t::template rebind_alloc<other_at>>;
+    };
+
+    budgeted_allocator_gt() = default;
+    budgeted_allocator_gt(allocator_t const& allocator, memory_budget_t* budget = nullptr) noexcept
+        : allocator_t(allocator), budget_(budget) {}
+    template <typename other_at>
+    budgeted_allocator_gt(budgeted_allocator_gt<other_at> const& other) noexcept
+        : allocator_t(other.inner()), budget_(other.budget()) {}
+
+    allocator_t const& inner() const noexcept { return *this; }
+    memory_budget_t* budget() const noexcept { return budget_; }
+
+    value_type* allocate(std::size_t n) {
+        if (budget_ && !budget_->acquire(n * sizeof(value_type)))
+            throw out_of_budget_t();
+        try {
+            return traits_t::allocate(*this, n);
+        }
+        catch (...) {
+            if (budget_)
+                budget_->release(n * sizeof(value_type));
+            throw;
+        }
+    }
+
+    void deallocate(value_type* pointer, std::size_t n) noexcept {
+        if (budget_)
+            budget_->release(n * sizeof(value_type));
+        traits_t::deallocate(*this, pointer, n);
+    }
+
+    template <typename other_at>
+    bool operator==(budgeted_allocator_gt<other_at> const& other) const noexcept {
+        return budget_ == other.budget() && inner() == other.inner();
+    }
+    template <typename other_at>
+    bool operator!=(budgeted_allocator_gt<other_at> const& other) const noexcept {
+        return !operator==(other);
+    }
+};
+
+} // namespace unum::ucset
@@ -0,0 +1,503 @@
+#pragma once
+#include <algorithm>   // `std::min`
+#include <array>       // `std::array` for free lists
+#include <atomic>      // `std::atomic` for statistics
+#include <cstddef>     // `std::max_align_t`
+#include <mutex>       // `std::mutex` for regions
+#include <new>         // `std::bad_alloc`
+#include <type_traits> // `std::true_type`
+#include <utility>     // `std::exchange`
+
+#if defined(__linux__)
+#include <sys/mman.h>    // `mmap`, `madvise`
+#include <sys/syscall.h> // `SYS_mbind`
+#include <unistd.h>      // `syscall`
+#endif
+
+#include "status.hpp"
+
+namespace unum::ucset {
+
+struct arena_config_t {
+    /// Granularity of requests to the OS. Large regions mean fewer TLB entries.
+    std::size_t region_bytes {1ul << 30};
+    /// Try explicit `MAP_HUGETLB` pages first, then Transparent Huge Pages.
+    bool huge_pages {true};
+    /// NUMA node to bind the regions to, or a negative number to skip binding.
+    int numa_node {-1};
+    /// If non-zero, all the regions are carved from a single reservation of that
+    /// many bytes, so any two blocks are at most that far apart.
+    /// @see `offset_links_t`.
+    std::size_t contiguous_bytes {0};
+};
+
+/**
+ * @brief Thread-safe arena, that maps memory from the OS in large regions
+ * and recycles fixed-size blocks, like tree nodes, through free lists.
+ *
+ * Regions are first requested with `MAP_HUGETLB`. If the system has no
+ * reserved huge pages, regular pages are mapped and advised as huge,
+ * so Transparent Huge Pages can back them. If a NUMA node is configured,
+ * regions are `mbind`-ed to it before the first touch. Every one of those
+ * steps degrades gracefully, and can be inspected afterwards.
+ *
+ * Requests larger than a region fraction get dedicated mappings, returned to
+ * the OS on release. Pages of freed small blocks are returned by `trim()`,
+ * and the regions themselves are only unmapped in the destructor.
+ *
+ * With `contiguous_bytes`, the address range is reserved upfront without
+ * committing memory, and the arena fails allocations once it's used up,
+ * instead of mapping regions elsewhere. Large requests are carved from the
+ * same reservation, and their pages are returned to the OS on release,
+ * while the address range is kept for the following large requests.
+ */
+class arena_t {
+
+    static constexpr std::size_t alignment_k = alignof(std::max_align_t);
+    /// Blocks are sized in 8-byte steps, so 40-byte nodes don't pay for 48.
+    /// Blocks, which are a multiple of `alignment_k`, are always fully aligned.
+    static constexpr std::size_t granularity_k = 8;
+    static constexpr std::size_t size_classes_k = 128;
+    static constexpr std::size_t largest_class_k = size_classes_k * granularity_k;
+    static constexpr std::size_t huge_page_k = 2ul << 20;
+
+    struct free_block_t {
+        free_block_t* next;
+    };
+
+    struct region_t {
+        region_t* next;
+        std::size_t capacity;
+    };
+
+    /// Run of adjacent free blocks, that `trim()` returned to the OS, except for this header.
+    struct span_t {
+        span_t* next;
+        std::size_t bytes;
+    };
+
+    arena_config_t config_;
+    std::mutex mutex_;
+    region_t* regions_ {nullptr};
+    char* reserved_ {nullptr};
+    std::size_t reserved_offset_ {0};
+    char* cursor_ {nullptr};
+    char* end_ {nullptr};
+    std::array<free_block_t*, size_classes_k> free_lists_ {};
+    span_t* spans_ {nullptr};
+    /// Released large blocks of the contiguous reservation, sorted by address.
+    span_t* large_spans_ {nullptr};
+
+    std::atomic<std::size_t> mapped_bytes_ {0};
+    std::atomic<std::size_t> huge_mapped_bytes_ {0};
+    std::atomic<std::size_t> bound_bytes_ {0};
+
+    static std::size_t round_up(std::size_t bytes, std::size_t alignment) noexcept {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+    static std::size_t block_bytes(std::size_t bytes, std::size_t alignment) noexcept {
+        return round_up(bytes ? bytes : 1, std::max(alignment, granularity_k));
+    }
+
+    static std::size_t size_class(std::size_t block_bytes) noexcept { return block_bytes / granularity_k - 1; }
+
+    void bind(void* address, std::size_t bytes) noexcept {
+#if defined(__linux__) && defined(SYS_mbind)
+        constexpr int mpol_bind_k = 2;
+        constexpr std::size_t mask_bits_k = 1024;
+        unsigned long mask[mask_bits_k / (8 * sizeof(unsigned long))] {};
+        std::size_t node = static_cast<std::size_t>(config_.numa_node);
+        if (node >= mask_bits_k)
+            return;
+        mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_mbind, address, bytes, mpol_bind_k, mask, mask_bits_k, 0) == 0)
+            bound_bytes_ += bytes;
+#else
+        (void)address, (void)bytes;
+#endif
+    }
+
+    /**
+     * @param[inout] bytes  Requested size, rounded up if explicit huge pages were used.
+     * @return Start of a new mapping of at least @p bytes, or `nullptr`.
+     */
+    void* map(std::size_t& bytes, bool explicit_huge_pages) noexcept {
+#if defined(__linux__)
+        void* address = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+        if (config_.huge_pages && explicit_huge_pages) {
+            std::size_t huge_bytes = round_up(bytes, huge_page_k);
+            address = mmap(nullptr, huge_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (address != MAP_FAILED)
+                bytes = huge_bytes, huge_mapped_bytes_ += huge_bytes;
+        }
+#endif
+        if (address == MAP_FAILED) {
+            address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED)
+                return nullptr;
+#if defined(MADV_HUGEPAGE)
+            if (config_.huge_pages)
+                madvise(address, bytes, MADV_HUGEPAGE);
+#endif
+        }
+        if (config_.numa_node >= 0)
+            bind(address, bytes);
+        mapped_bytes_ += bytes;
+        return address;
+#else
+        (void)explicit_huge_pages;
+        void* address = ::operator new(bytes, std::nothrow);
+        if (address)
+            mapped_bytes_ += bytes;
+        return address;
+#endif
+    }
+
+    /// Reserves the `contiguous_bytes` address range on the first call.
+    bool reserve() noexcept {
+        if (reserved_)
+            return true;
+#if defined(__linux__)
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+        flags |= MAP_NORESERVE;
+#endif
+        void* address = mmap(nullptr, config_.contiguous_bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (address == MAP_FAILED)
+            return false;
+#if defined(MADV_HUGEPAGE)
+        if (config_.huge_pages)
+            madvise(address, config_.contiguous_bytes, MADV_HUGEPAGE);
+#endif
+        reserved_ = static_cast<char*>(address);
+#else
+        reserved_ = static_cast<char*>(::operator new(config_.contiguous_bytes, std::nothrow));
+#endif
+        return reserved_;
+    }
+
+    /**
+     * @brief Slices the next region out of the contiguous reservation.
+     */
+    void* carve(std::size_t& bytes) noexcept {
+        if (!reserve())
+            return nullptr;
+        bytes = std::min(bytes, config_.contiguous_bytes - reserved_offset_);
+        if (bytes <= round_up(sizeof(region_t), alignment_k))
+            return nullptr;
+        char* address = reserved_ + std::exchange(reserved_offset_, reserved_offset_ + bytes);
+        if (config_.numa_node >= 0)
+            bind(address, bytes);
+        mapped_bytes_ += bytes;
+        return address;
+    }
+
+    void unmap(void* address, std::size_t bytes) noexcept {
+#if defined(__linux__)
+        munmap(address, bytes);
+#else
+        ::operator delete(address);
+#endif
+    }
+
+    /**
+     * @brief Serves a large request from the contiguous reservation, reusing the first
+     * released large block, that fits, and slicing a new one only if none does.
+     */
+    void* carve_large(std::size_t bytes) noexcept {
+        bytes = round_up(bytes, alignment_k);
+        for (span_t** link = &large_spans_; *link; link = &(*link)->next) {
+            span_t* span = *link;
+            if (span->bytes < bytes)
+                continue;
+            *link = span->next;
+            if (std::size_t rest = span->bytes - bytes; rest) {
+                auto tail = reinterpret_cast<span_t*>(reinterpret_cast<char*>(span) + bytes);
+                tail->next = *link;
+                tail->bytes = rest;
+                *link = tail;
+            }
+            return span;
+        }
+
+        if (!reserve() || config_.contiguous_bytes - reserved_offset_ < bytes)
+            return nullptr;
+        char* address = reserved_ + std::exchange(reserved_offset_, reserved_offset_ + bytes);
+        if (config_.numa_node >= 0)
+            bind(address, bytes);
+        mapped_bytes_ += bytes;
+        return address;
+    }
+
+    /**
+     * @brief Returns the pages of a large block of the contiguous reservation to the OS,
+     * merging it with the adjacent released blocks, so that later requests can reuse them.
+     */
+    void release_large(void* pointer, std::size_t bytes) noexcept {
+        auto block = static_cast<span_t*>(pointer);
+        block->bytes = round_up(bytes, alignment_k);
+        span_t** link = &large_spans_;
+        span_t* previous = nullptr;
+        for (; *link && *link < block; link = &(*link)->next)
+            previous = *link;
+        block->next = *link;
+        *link = block;
+        if (block->next && reinterpret_cast<char*>(block) + block->bytes == reinterpret_cast<char*>(block->next))
+            block->bytes += block->next->bytes, block->next = block->next->next;
+        if (previous && reinterpret_cast<char*>(previous) + previous->bytes == reinterpret_cast<char*>(block))
+            previous->bytes += block->bytes, previous->next = block->next, block = previous;
+
+#if defined(__linux__) && defined(MADV_DONTNEED)
+        // The header of the block stays resident, so its page is never returned.
+        auto const page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto begin = reinterpret_cast<std::uintptr_t>(pointer);
+        auto pages_begin = round_up(std::max(begin, reinterpret_cast<std::uintptr_t>(block) + sizeof(span_t)), page);
+        auto pages_end = (begin + round_up(bytes, alignment_k)) / page * page;
+        if (pages_begin < pages_end)
+            madvise(reinterpret_cast<void*>(pages_begin), pages_end - pages_begin, MADV_DONTNEED);
+#endif
+    }
+
+    bool grow() noexcept {
+        std::size_t bytes = config_.region_bytes;
+        void* address = config_.contiguous_bytes ? carve(bytes) : map(bytes, true);
+        auto region = static_cast<region_t*>(address);
+        if (!region)
+            return false;
+        region->next = regions_;
+        region->capacity = bytes;
+        regions_ = region;
+        cursor_ = reinterpret_cast<char*>(region) + round_up(sizeof(region_t), alignment_k);
+        end_ = reinterpret_cast<char*>(region) + bytes;
+        return true;
+    }
+
+    /**
+     * @brief Continues bump-allocating from a trimmed span, faulting its pages back in
+     * one by one, before mapping new regions. Spans always fit the largest block.
+     */
+    bool reuse_span() noexcept {
+        span_t* span = spans_;
+        if (!span)
+            return false;
+        spans_ = span->next;
+        cursor_ = reinterpret_cast<char*>(span);
+        end_ = cursor_ + span->bytes;
+        return true;
+    }
+
+    std::size_t padding(std::size_t block_bytes) const noexcept {
+        auto cursor = reinterpret_cast<std::uintptr_t>(cursor_);
+        return block_bytes % alignment_k ? 0 : round_up(cursor, alignment_k) - cursor;
+    }
+
+    bool is_large(std::size_t bytes) const noexcept {
+        return bytes > largest_class_k || bytes > config_.region_bytes / 4;
+    }
+
+  public:
+    explicit arena_t(arena_config_t config = {}) noexcept : config_(config) {}
+    arena_t(arena_t const&) = delete;
+    arena_t& operator=(arena_t const&) = delete;
+
+    ~arena_t() noexcept {
+        if (reserved_) {
+            unmap(reserved_, config_.contiguous_bytes);
+            return;
+        }
+        while (regions_) {
+            region_t* next = regions_->next;
+            unmap(regions_, regions_->capacity);
+            regions_ = next;
+        }
+    }
+
+    /**
+     * @param alignment Power of two, up to `alignof(std::max_align_t)`.
+     * @return Aligned block of @p bytes, or `nullptr`, if the OS refused to map more.
+     */
+    void* allocate(std::size_t bytes, std::size_t alignment = alignment_k) noexcept {
+        // Dedicated mappings avoid `MAP_HUGETLB`, so their length is known on release.
+        if (is_large(bytes)) {
+            if (config_.contiguous_bytes) {
+                std::unique_lock _ {mutex_};
+                return carve_large(bytes);
+            }
+            std::size_t mapping_bytes = bytes;
+            return map(mapping_bytes, false);
+        }
+
+        std::size_t block_bytes = arena_t::block_bytes(bytes, alignment);
+        std::size_t size_class = arena_t::size_class(block_bytes);
+        std::unique_lock _ {mutex_};
+        if (free_block_t* block = free_lists_[size_class]; block) {
+            free_lists_[size_class] = block->next;
+            return block;
+        }
+        std::size_t padding = this->padding(block_bytes);
+        if (cursor_ + padding + block_bytes > end_) {
+            if (!reuse_span() && !grow())
+                return nullptr;
+            // The last region of a reservation may be cut short of the block.
+            padding = this->padding(block_bytes);
+            if (cursor_ + padding + block_bytes > end_)
+                return nullptr;
+        }
+        cursor_ += padding;
+        return std::exchange(cursor_, cursor_ + block_bytes);
+    }
+
+    /**
+     * @param bytes, alignment  Must match the arguments of the `allocate` call.
+     */
+    void deallocate(void* pointer, std::size_t bytes, std::size_t alignment = alignment_k) noexcept {
+        if (is_large(bytes)) {
+            if (config_.contiguous_bytes) {
+                std::unique_lock _ {mutex_};
+                return release_large(pointer, bytes);
+            }
+            mapped_bytes_ -= bytes;
+            unmap(pointer, bytes);
+            return;
+        }
+
+        std::size_t size_class = arena_t::size_class(arena_t::block_bytes(bytes, alignment));
+        std::unique_lock _ {mutex_};
+        auto block = static_cast<free_block_t*>(pointer);
+        block->next = free_lists_[size_class];
+        free_lists_[size_class] = block;
+    }
+
+    /**
+     * @brief Returns whole pages, covered by runs of adjacent free blocks, to the OS
+     * with `MADV_DONTNEED`. Such runs leave the free lists and are later reused as bump
+     * space, while shorter runs stay where they are. Call it after mass deletions,
+     * once the containers have released their pooled memory with `shrink_to_fit()`.
+     *
+     * @return Number of bytes returned to the OS.
+     */
+    std::size_t trim() noexcept {
+#if defined(__linux__) && defined(MADV_DONTNEED)
+        struct run_t {
+            char* begin;
+            char* end;
+        };
+
+        std::unique_lock _ {mutex_};
+        std::size_t count = 0;
+        for (free_block_t const* block : free_lists_)
+            for (; block; block = block->next)
+                ++count;
+        if (!count)
+            return 0;
+        auto blocks = static_cast<run_t*>(::operator new(count * sizeof(run_t), std::nothrow));
+        if (!blocks)
+            return 0;
+
+        count = 0;
+        for (std::size_t size_class = 0; size_class != size_classes_k; ++size_class)
+            for (free_block_t* block = std::exchange(free_lists_[size_class], nullptr); block; block = block->next) {
+                char* begin = reinterpret_cast<char*>(block);
+                blocks[count++] = {begin, begin + (size_class + 1) * granularity_k};
+            }
+        std::sort(blocks, blocks + count, [](run_t const& a, run_t const& b) noexcept { return a.begin < b.begin; });
+
+        auto const page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+        std::size_t returned = 0;
+        for (std::size_t first = 0, last = 0; first != count; first = last) {
+            for (last = first + 1; last != count && blocks[last].begin == blocks[last - 1].end;)
+                ++last;
+
+            // The header of the span stays resident, so its page is never returned.
+            auto begin = reinterpret_cast<std::uintptr_t>(blocks[first].begin);
+            auto end = reinterpret_cast<std::uintptr_t>(blocks[last - 1].end);
+            auto pages_begin = round_up(begin + sizeof(span_t), page);
+            auto pages_end = end / page * page;
+            if (pages_begin < pages_end && madvise(reinterpret_cast<void*>(pages_begin),
+                                                   pages_end - pages_begin,
+                                                   MADV_DONTNEED) == 0) {
+                auto span = reinterpret_cast<span_t*>(begin);
+                span->next = spans_;
+                span->bytes = end - begin;
+                spans_ = span;
+                returned += pages_end - pages_begin;
+                continue;
+            }
+            for (std::size_t idx = first; idx != last; ++idx) {
+                std::size_t size_class = arena_t::size_class(blocks[idx].end - blocks[idx].begin);
+                auto block = reinterpret_cast<free_block_t*>(blocks[idx].begin);
+                block->next = free_lists_[size_class];
+                free_lists_[size_class] = block;
+            }
+        }
+        ::operator delete(blocks);
+        return returned;
+#else
+        return 0;
+#endif
+    }
+
+    arena_config_t const& config() const noexcept { return config_; }
+    std::size_t mapped_bytes() const noexcept { return mapped_bytes_.load(); }
+    /// Bytes backed by explicit huge pages. Transparent Huge Pages aren't counted.
+    std::size_t huge_mapped_bytes() const noexcept { return huge_mapped_bytes_.load(); }
+    /// Bytes successfully bound to the configured NUMA node.
+    std::size_t bound_bytes() const noexcept { return bound_bytes_.load(); }
+};
+
+/**
+ * @brief STL-compatible allocator, that draws memory from an @c `arena_t`.
+ * The arena must outlive all the containers using it.
+ * Default-constructed instances have no arena and fall back to the global heap.
+ */
+template <typename value_at = std::uint8_t>
+class arena_allocator_gt {
+    arena_t* arena_ {nullptr};
+
+  public:
+    using value_type = value_at;
+    using is_always_equal = std::false_type;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename other_at>
+    struct rebind {
+        using other = arena_allocator_gt<other_at>;
+    };
+
+    arena_allocator_gt() = default;
+    arena_allocator_gt(arena_t& arena) noexcept : arena_(&arena) {}
+    template <typename other_at>
+    arena_allocator_gt(arena_allocator_gt<other_at> const& other) noexcept : arena_(other.arena()) {}
+
+    arena_t* arena() const noexcept { return arena_; }
+
+    value_type* allocate(std::size_t n) {
+        static_assert(alignof(value_type) <= alignof(std::max_align_t), "Over-aligned types aren't supported");
+        if (!arena_)
+            return static_cast<value_type*>(::operator new(n * sizeof(value_type)));
+        if (void* pointer = arena_->allocate(n * sizeof(value_type), alignof(value_type)); pointer)
+            return static_cast<value_type*>(pointer);
+        throw std::bad_alloc();
+    }
+
+    void deallocate(value_type* pointer, std::size_t n) noexcept {
+        if (!arena_)
+            return ::operator delete(pointer);
+        arena_->deallocate(pointer, n * sizeof(value_type), alignof(value_type));
+    }
+
+    template <typename other_at>
+    bool operator==(arena_allocator_gt<other_at> const& other) const noexcept {
+        return arena_ == other.arena();
+    }
+    template <typename other_at>
+    bool operator!=(arena_allocator_gt<other_at> const& other) const noexcept {
+        return arena_ != other.arena();
+    }
+};
+
+} // namespace unum::ucset
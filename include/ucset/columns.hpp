@@ -0,0 +1,169 @@
+#pragma once
+#include <algorithm>   // `std::min`
+#include <cstdint>     // `std::uint32_t`
+#include <functional>  // `std::invoke`
+#include <limits>      // `std::numeric_limits`
+#include <tuple>       // `std::tuple`
+#include <utility>     // `std::index_sequence`
+#include <vector>      // `std::vector`
+
+#include "status.hpp"
+
+namespace unum::ucset {
+
+/**
+ * @brief Columnar copy of a range of any collection: the identifiers,
+ * followed by one contiguous column per projected field. Analytical scans
+ * over those columns avoid chasing tree pointers, and simple predicates,
+ * like `between_gt`, compile into vectorized comparisons.
+ *
+ * Rows follow the order, in which the collection visits them in `range`,
+ * which isn't sorted for `consistent_avl_gt`. Identifiers and fields are
+ * copied, so views, like the `std::string_view` keys of `front_coded_gt`,
+ * would dangle and can't be exported.
+ *
+ * @tparam identifier_at    Type of the exported keys.
+ * @tparam fields_at        Types of the projected fields, one column each.
+ */
+template <typename identifier_at, typename... fields_at>
+class columns_gt {
+  public:
+    using identifier_t = identifier_at;
+    using fields_t = std::tuple<fields_at...>;
+    using position_t = std::uint32_t;
+    using positions_t = std::vector<position_t>;
+    static constexpr std::size_t fields_k = sizeof...(fields_at);
+
+    template <std::size_t field_ak>
+    using field_t = std::tuple_element_t<field_ak, fields_t>;
+
+  private:
+    std::vector<identifier_t> identifiers_;
+    std::tuple<std::vector<fields_at>...> columns_;
+
+    template <std::size_t... fields_ak>
+    void clear(std::index_sequence<fields_ak...>) noexcept {
+        identifiers_.clear();
+        (std::get<fields_ak>(columns_).clear(), ...);
+    }
+
+    template <std::size_t... fields_ak>
+    void reserve(std::size_t rows, std::index_sequence<fields_ak...> fields) {
+        clear(fields);
+        identifiers_.reserve(rows);
+        (std::get<fields_ak>(columns_).reserve(rows), ...);
+    }
+
+    /// Never reallocates, but copying owning identifiers or fields, like `std::string`, may throw.
+    template <typename element_at, typename... projections_at, std::size_t... fields_ak>
+    void append(element_at const& element,
+                std::index_sequence<fields_ak...>,
+                projections_at const&... projections) {
+        identifiers_.push_back(identifier_t(element));
+        (std::get<fields_ak>(columns_).push_back(std::invoke(projections, element)), ...);
+    }
+
+  public:
+    [[nodiscard]] std::size_t size() const noexcept { return identifiers_.size(); }
+    [[nodiscard]] std::vector<identifier_t> const& identifiers() const noexcept { return identifiers_; }
+
+    template <std::size_t field_ak>
+    [[nodiscard]] std::vector<field_t<field_ak>> const& column() const noexcept {
+        return std::get<field_ak>(columns_);
+    }
+
+    /**
+     * @brief Replaces the contents with the elements of the `[lower, upper]` range of a @p collection.
+     * Rows are written into buffers reserved for `collection.size()` elements, so that the
+     * `noexcept` callback of `range` never allocates. If more elements arrive, than the
+     * collection reported, the export restarts with twice the capacity. If copying
+     * a row fails, the remaining elements are skipped, the columns are emptied, and
+     * the error is returned.
+     *
+     * @param projections   One callable or member pointer per field, receiving the element.
+     */
+    template <typename collection_at, typename lower_at, typename upper_at, typename... projections_at>
+    [[nodiscard]] status_t export_range(collection_at const& collection,
+                                        lower_at const& lower,
+                                        upper_at const& upper,
+                                        projections_at const&... projections) noexcept {
+        static_assert(sizeof...(projections_at) == fields_k, "Every field needs a projection.");
+        auto fields = std::index_sequence_for<fields_at...> {};
+        std::size_t capacity = std::max<std::size_t>(collection.size(), 1);
+        for (;; capacity *= 2) {
+            if (auto status = invoke_safely([&] { reserve(capacity, fields); }); !status)
+                return status;
+
+            bool overflown = false;
+            status_t appended;
+            auto status = collection.range(lower, upper, [&](auto const& element) noexcept {
+                if (!appended)
+                    return;
+                if (identifiers_.size() == capacity)
+                    overflown = true;
+                else
+                    appended = invoke_safely([&] { append(element, fields, projections...); });
+            });
+            if (status && !appended) {
+                clear(fields);
+                return appended;
+            }
+            if (!status || !overflown)
+                return size() > std::numeric_limits<position_t>::max() ? status_t {invalid_argument_k} : status;
+        }
+    }
+
+    /**
+     * @brief Evaluates the @p kernel over every value in the column of the @p field_ak,
+     * appending the positions of the matching rows to @p positions in ascending order.
+     * Matches are gathered into 64-bit masks, which keeps the inner loop branchless,
+     * so the compiler can vectorize it, as long as the @p kernel is branchless too.
+     */
+    template <std::size_t field_ak, typename kernel_at>
+    [[nodiscard]] status_t scan_filter(kernel_at const& kernel, positions_t& positions) const noexcept {
+        static_assert(noexcept(kernel(std::declval<field_t<field_ak> const&>())), "Kernels must not throw.");
+        auto const& column = std::get<field_ak>(columns_);
+        auto const* values = column.data();
+        std::size_t const count = column.size();
+        return invoke_safely([&] {
+            for (std::size_t base = 0; base < count; base += 64) {
+                std::size_t const width = std::min<std::size_t>(64, count - base);
+                std::uint64_t mask = 0;
+                for (std::size_t offset = 0; offset != width; ++offset)
+                    mask |= std::uint64_t(kernel(values[base + offset])) << offset;
+                for (; mask; mask &= mask - 1)
+                    positions.push_back(static_cast<position_t>(base + __builtin_ctzll(mask)));
+            }
+        });
+    }
+};
+
+/**
+ * @brief Branchless kernel for `columns_gt::scan_filter`, matching values in `[low, high]`.
+ */
+template <typename value_at>
+struct between_gt {
+    value_at low;
+    value_at high;
+    bool operator()(value_at const& value) const noexcept { return (value >= low) & (value <= high); }
+};
+
+template <typename value_at>
+struct less_than_gt {
+    value_at threshold;
+    bool operator()(value_at const& value) const noexcept { return value < threshold; }
+};
+
+template <typename value_at>
+struct greater_than_gt {
+    value_at threshold;
+    bool operator()(value_at const& value) const noexcept { return value > threshold; }
+};
+
+template <typename value_at>
+struct equal_to_gt {
+    value_at expected;
+    bool operator()(value_at const& value) const noexcept { return value == expected; }
+};
+
+} // namespace unum::ucset
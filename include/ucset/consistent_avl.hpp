@@ -1,15 +1,116 @@
 #pragma once
-#include <algorithm> // `std::max`
-#include <memory>    // `std::allocator`
-#include <optional>  // `std::optional`
-#include <mutex>     // `std::unique_lock`
-#include <ostream>   // `std::endl`
-#include <utility>   // `std::exchange`
-
+#include <algorithm>   // `std::max`
+#include <cassert>     // `assert`
+#include <functional>  // `std::less`
+#include <iterator>    // `std::distance`
+#include <memory>      // `std::allocator`
+#include <optional>    // `std::optional`
+#include <mutex>       // `std::unique_lock`
+#include <ostream>     // `std::endl`
+#include <random>      // `std::uniform_int_distribution`
+#include <type_traits> // `std::void_t`
+#include <utility>     // `std::exchange`
+#include <vector>      // `std::vector` for watches
+
+#include "allocators.hpp"
 #include "status.hpp"
+#include "tracing.hpp"
 
 namespace unum::ucset {
 
+/**
+ * @brief Default links policy of @c `avl_node_gt`, storing full 64-bit pointers.
+ */
+struct pointer_links_t {
+    template <typename node_at>
+    using link_gt = node_at*;
+
+    template <typename allocator_at>
+    static bool admits(allocator_at const&) noexcept {
+        return true;
+    }
+};
+
+/**
+ * @brief A 32-bit link, that behaves like a `node_at*`, but stores the distance
+ * from its own address to the target node in 8-byte units. Copying the link
+ * re-encodes that distance, so it can be moved around like a plain pointer.
+ *
+ * ! Every pair of linked nodes must be less than 16 GiB apart.
+ * ! That holds for nodes of one @c `arena_t` with a `contiguous_bytes` reservation
+ * ! of at most 16 GiB, which `offset_links_t::admits` checks in every build.
+ */
+template <typename node_at>
+class offset_link_gt {
+    using offset_t = std::int32_t;
+    static constexpr std::uintptr_t unit_k = 8;
+
+    offset_t offset_ = 0;
+
+    std::uintptr_t base() const noexcept { return reinterpret_cast<std::uintptr_t>(this) & ~(unit_k - 1); }
+
+  public:
+    offset_link_gt() noexcept = default;
+    offset_link_gt(node_at* node) noexcept { *this = node; }
+    offset_link_gt(offset_link_gt const& other) noexcept { *this = static_cast<node_at*>(other); }
+    offset_link_gt& operator=(offset_link_gt const& other) noexcept { return *this = static_cast<node_at*>(other); }
+
+    offset_link_gt& operator=(node_at* node) noexcept {
+        if (!node) {
+            offset_ = 0;
+            return *this;
+        }
+        // The base is rounded down, so even a link to its own node is never zero.
+        auto distance = static_cast<std::intptr_t>(reinterpret_cast<std::uintptr_t>(node) - base());
+        offset_ = static_cast<offset_t>(distance / static_cast<std::intptr_t>(unit_k));
+        assert(distance % static_cast<std::intptr_t>(unit_k) == 0 && offset_ == distance / 8 && offset_ != 0);
+        return *this;
+    }
+
+    operator node_at*() const noexcept {
+        return offset_ ? reinterpret_cast<node_at*>(base() + static_cast<std::intptr_t>(offset_) * unit_k) : nullptr;
+    }
+    node_at* operator->() const noexcept { return *this; }
+};
+
+/**
+ * @brief Detects allocators, that expose the `arena_t` they draw from, like `arena_allocator_gt`.
+ */
+template <typename allocator_at, typename = void>
+struct has_arena_gt : std::false_type {};
+
+template <typename allocator_at>
+struct has_arena_gt<allocator_at, std::void_t<decltype(std::declval<allocator_at const&>().arena())>>
+    : std::true_type {};
+
+/**
+ * @brief Links policy of @c `avl_node_gt`, storing 32-bit self-relative offsets.
+ * Saves 8 bytes per node and improves cache density, but is only valid, if all
+ * the nodes live in a single contiguous memory range of at most 16 GiB.
+ * @see `offset_link_gt`, `arena_config_t::contiguous_bytes`.
+ */
+struct offset_links_t {
+    template <typename node_at>
+    using link_gt = offset_link_gt<node_at>;
+
+    /// Largest span of addresses, in which any two nodes can still be linked.
+    static constexpr std::size_t reach_k = std::size_t(1) << 34;
+
+    /**
+     * @brief Accepts only allocators, drawing from an arena with a `contiguous_bytes` reservation
+     * within the `reach_k`, as any other nodes may end up too far apart to be linked.
+     */
+    template <typename allocator_at>
+    static bool admits(allocator_at const& allocator) noexcept {
+        if constexpr (has_arena_gt<allocator_at>()) {
+            auto arena = allocator.arena();
+            return arena && arena->config().contiguous_bytes && arena->config().contiguous_bytes <= reach_k;
+        }
+        else
+            return false;
+    }
+};
+
 /**
  * @brief AVL-Trees are some of the simplest yet performant Binary Search Trees.
  * This "node" class implements the primary logic, but doesn't take part in
@@ -25,18 +126,23 @@ namespace unum::ucset {
  *                          @code
  *                              bool operator ()(entry_at, entry_at) const
  *                          @endcode
+ * @tparam links_at         Representation of child links, like @c `pointer_links_t`
+ *                          or @c `offset_links_t`. The algorithms are shared.
  */
-template <typename entry_at, typename comparator_at>
+template <typename entry_at, typename comparator_at, typename links_at = pointer_links_t>
 class avl_node_gt {
   public:
     using entry_t = entry_at;
     using comparator_t = comparator_at;
-    using height_t = std::int16_t;
+    using links_t = links_at;
+    /// Even with 2^64 nodes, the height of an AVL tree stays below 128.
+    using height_t = std::int8_t;
     using node_t = avl_node_gt;
+    using link_t = typename links_t::template link_gt<node_t>;
 
     entry_t entry;
-    node_t* left = nullptr;
-    node_t* right = nullptr;
+    link_t left = nullptr;
+    link_t right = nullptr;
     /**
      * @brief Root has the biggest `height` in the tree.
      * Zero is possible only in the uninitialized detached state.
@@ -97,8 +203,7 @@ class avl_node_gt {
      * @return NULL if nothing was found.
      */
     template <typename comparable_at>
-    static node_t* find(node_t* node, comparable_at&& comparable) noexcept {
-        auto less = comparator_t {};
+    static node_t* find(node_t* node, comparable_at&& comparable, comparator_t const& less) noexcept {
         while (node) {
             if (less(comparable, node->entry))
                 node = node->left;
@@ -110,15 +215,32 @@ class avl_node_gt {
         return node;
     }
 
+    /**
+     * @brief Searches for an entry equal to @p comparable, that has no equal neighbors.
+     * Ancestors on the search path are never equal, so only the two adjacent
+     * subtrees are checked, continuing the same single descent.
+     * @return NULL if nothing was found, or if more than one entry matches.
+     */
+    template <typename comparable_at>
+    static node_t* find_unique(node_t* node, comparable_at&& comparable, comparator_t const& less) noexcept {
+        node = find(node, comparable, less);
+        if (!node)
+            return nullptr;
+        if (node->left && !less(find_max(node->left)->entry, comparable))
+            return nullptr;
+        if (node->right && !less(comparable, find_min(node->right)->entry))
+            return nullptr;
+        return node;
+    }
+
     /**
      * @brief Find the smallest entry, bigger than or equal to the provided one.
      * @param comparable Any key comparable with stored entries.
      * @return NULL if nothing was found.
      */
     template <typename comparable_at>
-    static node_t* lower_bound(node_t* node, comparable_at&& comparable) noexcept {
+    static node_t* lower_bound(node_t* node, comparable_at&& comparable, comparator_t const& less) noexcept {
         node_t* successor = nullptr;
-        comparator_t less;
         while (node) {
             // If the given key is less than the root node, visit the left
             // subtree, taking current node as potential successor.
@@ -154,9 +276,8 @@ class avl_node_gt {
      * > store parents in nodes and have complex logic.
      */
     template <typename comparable_at>
-    static node_t* upper_bound(node_t* node, comparable_at&& comparable) noexcept {
+    static node_t* upper_bound(node_t* node, comparable_at&& comparable, comparator_t const& less) noexcept {
         node_t* successor = nullptr;
-        comparator_t less;
         while (node) {
             // If the given key is less than the root node, visit the left
             // subtree, taking current node as potential successor.
@@ -188,18 +309,20 @@ class avl_node_gt {
      * @warning Current recursive implementation is suboptimal.
      */
     template <typename comparable_a_at, typename comparable_b_at>
-    static node_t* lowest_common_ancestor(node_t* node, comparable_a_at&& a, comparable_b_at&& b) noexcept {
+    static node_t* lowest_common_ancestor(node_t* node,
+                                          comparable_a_at&& a,
+                                          comparable_b_at&& b,
+                                          comparator_t const& less) noexcept {
         if (!node)
             return nullptr;
 
-        auto less = comparator_t {};
         // If both `a` and `b` are smaller than `node`, then LCA lies in left
         if (less(a, node->entry) && less(b, node->entry))
-            return lowest_common_ancestor(node->left, a, b);
+            return lowest_common_ancestor(node->left, a, b, less);
 
         // If both `a` and `b` are greater than `node`, then LCA lies in right
         else if (less(node->entry, a) && less(node->entry, b))
-            return lowest_common_ancestor(node->right, a, b);
+            return lowest_common_ancestor(node->right, a, b, less);
 
         else
             return node;
@@ -217,18 +340,21 @@ class avl_node_gt {
      * @warning Current recursive implementation is suboptimal.
      */
     template <typename lower_at, typename upper_at, typename callback_at>
-    static node_interval_t range(node_t* node, lower_at&& low, upper_at&& high, callback_at&& callback) noexcept {
+    static node_interval_t range(node_t* node,
+                                 lower_at&& low,
+                                 upper_at&& high,
+                                 callback_at&& callback,
+                                 comparator_t const& less) noexcept {
         if (!node)
             return {};
 
         // If this node fits into the interval - analyze its children.
         // The first call to reach this branch in the call-stack
         // will be by definition the Lowest Common Ancestor.
-        auto less = comparator_t {};
         if (!less(high, node->entry) && !less(node->entry, low)) {
             callback(node);
-            auto left_sub_interval = range(node->left, low, high, callback);
-            auto right_sub_interval = range(node->right, low, high, callback);
+            auto left_sub_interval = range(node->left, low, high, callback, less);
+            auto right_sub_interval = range(node->right, low, high, callback, less);
 
             auto result = node_interval_t {};
             result.lower_bound = left_sub_interval.lower_bound ? left_sub_interval.lower_bound : node;
@@ -238,15 +364,15 @@ class avl_node_gt {
         }
 
         else if (less(node->entry, low))
-            return range(node->right, low, high, callback);
+            return range(node->right, low, high, callback, less);
 
         else
-            return range(node->left, low, high, callback);
+            return range(node->left, low, high, callback, less);
     }
 
     template <typename comparable_at>
-    static node_interval_t equal_range(node_t* node, comparable_at&& comparable) noexcept {
-        return range(node, comparable, comparable);
+    static node_interval_t equal_range(node_t* node, comparable_at&& comparable, comparator_t const& less) noexcept {
+        return range(node, comparable, comparable, no_op_t {}, less);
     }
 
     /**
@@ -257,7 +383,6 @@ class avl_node_gt {
      */
     template <typename generator_at>
     static node_t* sample(node_t* node, generator_at&& generator) noexcept {
-        auto less = comparator_t {};
         while (node) {
             auto count_left = node->left ? 1ul << node->left->height : 0ul;
             auto count_right = node->right ? 1ul << node->right->height : 0ul;
@@ -284,19 +409,25 @@ class avl_node_gt {
         lower_at&& low,
         upper_at&& high,
         generator_at&& generator,
-        predicate_at&& predicate) noexcept {
+        predicate_at&& predicate,
+        comparator_t const& less) noexcept {
 
         std::size_t count_matches = 0;
-        range(node, low, high, [&](node_t* node) noexcept { count_matches += predicate(node); });
+        range(node, low, high, [&](node_t* node) noexcept { count_matches += predicate(node); }, less);
 
         node_t* result = node;
         std::uniform_int_distribution<std::size_t> distribution {0, count_matches + 1};
         auto choice = distribution(generator);
         if (choice != 0)
-            range(node, low, high, [&](node_t* node) noexcept {
-                choice -= predicate(node);
-                result = choice != 0 ? result : node;
-            });
+            range(
+                node,
+                low,
+                high,
+                [&](node_t* node) noexcept {
+                    choice -= predicate(node);
+                    result = choice != 0 ? result : node;
+                },
+                less);
 
         return result;
     }
@@ -343,11 +474,12 @@ class avl_node_gt {
     };
 
     template <typename comparable_at>
-    inline static node_t* rebalance_after_insert(node_t* node, comparable_at&& comparable) noexcept {
+    inline static node_t* rebalance_after_insert(node_t* node,
+                                                 comparable_at&& comparable,
+                                                 comparator_t const& less) noexcept {
         // Update height and check if branches aren't balanced
         node->height = std::max(get_height(node->left), get_height(node->right)) + 1;
         auto balance = get_balance(node);
-        auto less = comparator_t {};
 
         // Left Left Case
         if (balance > 1 && less(comparable, node->left->entry))
@@ -375,7 +507,8 @@ class avl_node_gt {
     static find_or_make_result_t find_or_make(node_t* node,
                                               comparable_at&& comparable,
                                               callback_found_at&& callback_found,
-                                              callback_make_at&& callback_make) noexcept {
+                                              callback_make_at&& callback_make,
+                                              comparator_t const& less) noexcept {
         if (!node) {
             node = callback_make();
             if (node) {
@@ -383,22 +516,22 @@ class avl_node_gt {
                 node->right = nullptr;
                 node->height = 1;
             }
-            return {node, node, true};
+            // On allocation failure nothing is inserted and the parent stays intact.
+            return {node, node, node != nullptr};
         }
 
-        auto less = comparator_t {};
         if (less(comparable, node->entry)) {
-            auto downstream = find_or_make(node->left, comparable, callback_found, callback_make);
+            auto downstream = find_or_make(node->left, comparable, callback_found, callback_make, less);
             node->left = downstream.root;
             if (downstream.inserted)
-                node = rebalance_after_insert(node, downstream.match->entry);
+                node = rebalance_after_insert(node, downstream.match->entry, less);
             return {node, downstream.match, downstream.inserted};
         }
         else if (less(node->entry, comparable)) {
-            auto downstream = find_or_make(node->right, comparable, callback_found, callback_make);
+            auto downstream = find_or_make(node->right, comparable, callback_found, callback_make, less);
             node->right = downstream.root;
             if (downstream.inserted)
-                node = rebalance_after_insert(node, downstream.match->entry);
+                node = rebalance_after_insert(node, downstream.match->entry, less);
             return {node, downstream.match, downstream.inserted};
         }
         else {
@@ -409,7 +542,10 @@ class avl_node_gt {
     }
 
     template <typename node_allocator_at>
-    static find_or_make_result_t insert(node_t* node, entry_t&& entry, node_allocator_at&& node_allocator) noexcept {
+    static find_or_make_result_t insert(node_t* node,
+                                        entry_t&& entry,
+                                        node_allocator_at&& node_allocator,
+                                        comparator_t const& less) noexcept {
         auto found = [&](node_t* node) noexcept {
         };
         auto make = [&]() noexcept -> node_t* {
@@ -418,12 +554,15 @@ class avl_node_gt {
                 new (&node->entry) entry_t(std::move(entry));
             return node;
         };
-        auto result = find_or_make(node, entry, found, make);
+        auto result = find_or_make(node, entry, found, make, less);
         return result;
     }
 
     template <typename node_allocator_at>
-    static find_or_make_result_t upsert(node_t* node, entry_t&& entry, node_allocator_at&& node_allocator) noexcept {
+    static find_or_make_result_t upsert(node_t* node,
+                                        entry_t&& entry,
+                                        node_allocator_at&& node_allocator,
+                                        comparator_t const& less) noexcept {
         auto found = [&](node_t* node) noexcept {
             node->entry = std::move(entry);
         };
@@ -433,16 +572,17 @@ class avl_node_gt {
                 new (&node->entry) entry_t(std::move(entry));
             return node;
         };
-        auto result = find_or_make(node, entry, found, make);
+        auto result = find_or_make(node, entry, found, make, less);
         return result;
     }
 
-    static find_or_make_result_t insert(node_t* node, node_t* new_child) noexcept {
+    static find_or_make_result_t insert(node_t* node, node_t* new_child, comparator_t const& less) noexcept {
         return find_or_make(
             node,
             new_child->entry,
             [](node_t*) noexcept {},
-            [=]() noexcept { return new_child; });
+            [=]() noexcept { return new_child; },
+            less);
     }
 
 #pragma mark - Removals
@@ -485,13 +625,13 @@ class avl_node_gt {
      * @brief Pops the root replacing it with one of descendants, if present.
      * @param comparable Any key comparable with stored entries.
      */
-    static extract_result_t extract(node_t* node) noexcept {
+    static extract_result_t extract(node_t* node, comparator_t const& less) noexcept {
 
         // If the node has two children, replace it with the
         // smallest entry in the right branch.
         if (node->left && node->right) {
             node_t* midpoint = find_min(node->right);
-            auto downstream = extract(node->right, midpoint->entry);
+            auto downstream = extract(node->right, midpoint->entry, less);
             midpoint = downstream.extracted.release();
             midpoint->left = node->left;
             midpoint->right = downstream.root;
@@ -523,13 +663,12 @@ class avl_node_gt {
      * @param comparable Any key comparable with stored entries.
      */
     template <typename comparable_at>
-    static extract_result_t extract(node_t* node, comparable_at&& comparable) noexcept {
+    static extract_result_t extract(node_t* node, comparable_at&& comparable, comparator_t const& less) noexcept {
         if (!node)
             return {node, {}};
 
-        auto less = comparator_t {};
         if (less(comparable, node->entry)) {
-            auto downstream = extract(node->left, comparable);
+            auto downstream = extract(node->left, comparable, less);
             node->left = downstream.root;
             if (downstream.extracted)
                 node = rebalance_after_extract(node);
@@ -537,7 +676,7 @@ class avl_node_gt {
         }
 
         else if (less(node->entry, comparable)) {
-            auto downstream = extract(node->right, comparable);
+            auto downstream = extract(node->right, comparable, less);
             node->right = downstream.root;
             if (downstream.extracted)
                 node = rebalance_after_extract(node);
@@ -546,7 +685,7 @@ class avl_node_gt {
 
         else
             // We have found the node to extract!
-            return extract(node);
+            return extract(node, less);
     }
 
     struct remove_if_result_t {
@@ -564,30 +703,124 @@ class avl_node_gt {
 
 template <typename entry_at,
           typename comparator_at,
-          typename node_allocator_at = std::allocator<avl_node_gt<entry_at, comparator_at>>>
-class avl_tree_gt {
+          typename node_allocator_at = std::allocator<avl_node_gt<entry_at, comparator_at>>,
+          typename links_at = pointer_links_t>
+class avl_tree_gt : private functor_holder_gt<comparator_at> {
   public:
-    using node_t = avl_node_gt<entry_at, comparator_at>;
+    using node_t = avl_node_gt<entry_at, comparator_at, links_at>;
     using node_allocator_t = node_allocator_at;
     using comparator_t = comparator_at;
     using entry_t = entry_at;
     using avl_tree_t = avl_tree_gt;
 
   private:
+    using comparator_holder_t = functor_holder_gt<comparator_t>;
+
+    /**
+     * @brief Contiguous array of nodes, allocated by `defragment`, that is released
+     * together with its last live node. Slabs, that are less than half full, are
+     * evacuated by the following `defragment` passes, so single survivors don't pin them.
+     */
+    struct slab_t {
+        node_t* begin = nullptr;
+        std::size_t capacity = 0;
+        std::size_t live = 0;
+
+        bool sparse() const noexcept { return live * 2 < capacity; }
+    };
+    using slabs_allocator_t = typename std::allocator_traits<node_allocator_t>::template rebind_alloc<slab_t>;
+    using slabs_t = std::vector<slab_t, slabs_allocator_t>;
+    using slab_iterator_t = typename slabs_t::iterator;
+
     node_t* root_ = nullptr;
     std::size_t size_ = 0;
     node_allocator_t allocator_;
+    /// Sorted by addresses, so that releasing a node finds its slab in a binary search.
+    slabs_t slabs_;
+
+    /**
+     * @return The slab, that the @p node belongs to, or the end of `slabs_`.
+     * Nodes outside of the address range of all the slabs skip the binary search.
+     */
+    slab_iterator_t slab_of(node_t const* node) noexcept {
+        std::less<node_t const*> less;
+        if (slabs_.empty() || less(node, slabs_.front().begin) ||
+            !less(node, slabs_.back().begin + slabs_.back().capacity))
+            return slabs_.end();
+        auto after = std::upper_bound(slabs_.begin(), slabs_.end(), node, [&](node_t const* node, slab_t const& slab) {
+            return less(node, slab.begin);
+        });
+        auto slab = std::prev(after);
+        return less(node, slab->begin + slab->capacity) ? slab : slabs_.end();
+    }
+
+    /**
+     * @return True, if the @p node belongs to one of the slabs, which is released with its last node.
+     */
+    bool release_from_slab(node_t* node) noexcept {
+        auto slab = slab_of(node);
+        if (slab == slabs_.end())
+            return false;
+        if (--slab->live == 0) {
+            allocator_.deallocate(slab->begin, slab->capacity);
+            slabs_.erase(slab);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Checks, if the @p node is worth relocating: it pins a sparse slab, or it
+     * isn't adjacent in memory to either of its neighbors in key order, which are
+     * the @p previous and the @p next ones. Runs of adjacent nodes are left in place.
+     */
+    bool scattered(node_t const* previous, node_t* node, node_t const* next) noexcept {
+        if (auto slab = slab_of(node); slab != slabs_.end() && slab->sparse())
+            return true;
+        return (!previous || previous + 1 != node) && (!next || node + 1 != next);
+    }
+
+    /**
+     * @brief Moves the entry and the links of a @p node into the uninitialized @p target,
+     * re-linking the parent, found in a descent from the root, and destroys the @p node.
+     */
+    void relocate(node_t* node, node_t* target) noexcept {
+        node_t* parent = nullptr;
+        for (node_t* current = root_; current != node;) {
+            parent = current;
+            current = comparator()(node->entry, current->entry) ? current->left : current->right;
+        }
+
+        new (&target->entry) entry_t(std::move(node->entry));
+        target->left = node->left;
+        target->right = node->right;
+        target->height = node->height;
+        if (!parent)
+            root_ = target;
+        else if (parent->left == node)
+            parent->left = target;
+        else
+            parent->right = target;
+        destroy_node(node);
+    }
 
   public:
     avl_tree_gt() noexcept = default;
+    explicit avl_tree_gt(node_allocator_t const& allocator, comparator_t const& comparator = {}) noexcept
+        : comparator_holder_t(comparator), allocator_(allocator), slabs_(slabs_allocator_t(allocator)) {}
     avl_tree_gt(avl_tree_gt&& other) noexcept
-        : root_(std::exchange(other.root_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+        : comparator_holder_t(other.comparator()), root_(std::exchange(other.root_, nullptr)),
+          size_(std::exchange(other.size_, 0)), allocator_(other.allocator_), slabs_(std::move(other.slabs_)) {}
     avl_tree_gt& operator=(avl_tree_gt&& other) noexcept {
+        std::swap(static_cast<comparator_holder_t&>(*this), static_cast<comparator_holder_t&>(other));
         std::swap(root_, other.root_);
         std::swap(size_, other.size_);
+        std::swap(allocator_, other.allocator_);
+        std::swap(slabs_, other.slabs_);
         return *this;
     }
 
+    comparator_t const& comparator() const noexcept { return this->functor(); }
+
     ~avl_tree_gt() { clear(); }
     std::size_t size() const noexcept { return size_; }
     std::size_t height() noexcept { return root_ ? root_->height : 0; }
@@ -596,6 +829,17 @@ class avl_tree_gt {
     node_allocator_t& allocator() noexcept { return allocator_; }
     node_allocator_t const& allocator() const noexcept { return allocator_; }
 
+    /**
+     * @brief Allocates a node, converting allocation failures into a `nullptr`,
+     * as STL allocators signal them with exceptions.
+     * @param[out] error    Reason of the failure, like `out_of_memory_arena_k`.
+     */
+    node_t* allocate_node(errc_t& error) noexcept {
+        node_t* node = nullptr;
+        error = invoke_safely([&] { node = allocator_.allocate(1); }).errc;
+        return node;
+    }
+
     std::size_t total_imbalance() const noexcept {
         std::size_t abs_sum = 0;
         node_t::for_each_top_down(root_,
@@ -605,37 +849,38 @@ class avl_tree_gt {
 
     template <typename comparable_at>
     node_t* find(comparable_at&& comparable) noexcept {
-        return node_t::find(root_, std::forward<comparable_at>(comparable));
+        return node_t::find(root_, std::forward<comparable_at>(comparable), comparator());
     }
 
     template <typename comparable_at>
     node_t* lower_bound(comparable_at&& comparable) noexcept {
-        return node_t::lower_bound(root_, std::forward<comparable_at>(comparable));
+        return node_t::lower_bound(root_, std::forward<comparable_at>(comparable), comparator());
     }
 
     template <typename comparable_at>
     node_t* upper_bound(comparable_at&& comparable) noexcept {
-        return node_t::upper_bound(root_, std::forward<comparable_at>(comparable));
+        return node_t::upper_bound(root_, std::forward<comparable_at>(comparable), comparator());
     }
 
     template <typename comparable_at>
     node_t const* find(comparable_at&& comparable) const noexcept {
-        return node_t::find(root_, std::forward<comparable_at>(comparable));
+        return node_t::find(root_, std::forward<comparable_at>(comparable), comparator());
     }
 
     template <typename comparable_at>
     node_t const* lower_bound(comparable_at&& comparable) const noexcept {
-        return node_t::lower_bound(root_, std::forward<comparable_at>(comparable));
+        return node_t::lower_bound(root_, std::forward<comparable_at>(comparable), comparator());
     }
 
     template <typename comparable_at>
     node_t const* upper_bound(comparable_at&& comparable) const noexcept {
-        return node_t::upper_bound(root_, std::forward<comparable_at>(comparable));
+        return node_t::upper_bound(root_, std::forward<comparable_at>(comparable), comparator());
     }
 
     struct upsert_result_t {
         node_t* node = nullptr;
         bool inserted = false;
+        errc_t errc = success_k;
 
         /**
          * @return True if the allocation of the new node has failed.
@@ -649,22 +894,24 @@ class avl_tree_gt {
 
     template <typename comparable_at>
     upsert_result_t insert(comparable_at&& comparable) noexcept {
+        errc_t errc = success_k;
         auto result = node_t::insert(root_, std::forward<comparable_at>(comparable), [&]() noexcept {
-            return allocator_.allocate(1);
-        });
+            return allocate_node(errc);
+        }, comparator());
         root_ = result.root;
         size_ += result.inserted;
-        return {result.match, result.inserted};
+        return {result.match, result.inserted, errc};
     }
 
     template <typename comparable_at>
     upsert_result_t upsert(comparable_at&& comparable) noexcept {
+        errc_t errc = success_k;
         auto result = node_t::upsert(root_, std::forward<comparable_at>(comparable), [&]() noexcept {
-            return allocator_.allocate(1);
-        });
+            return allocate_node(errc);
+        }, comparator());
         root_ = result.root;
         size_ += result.inserted;
-        return {result.match, result.inserted};
+        return {result.match, result.inserted, errc};
     }
 
     struct extract_result_t {
@@ -673,7 +920,7 @@ class avl_tree_gt {
 
         ~extract_result_t() noexcept {
             if (node_ptr_)
-                tree_->allocator_.deallocate(node_ptr_, 1);
+                tree_->destroy_node(node_ptr_);
         }
         extract_result_t(extract_result_t const&) = delete;
         extract_result_t& operator=(extract_result_t const&) = delete;
@@ -683,7 +930,7 @@ class avl_tree_gt {
 
     template <typename comparable_at>
     extract_result_t extract(comparable_at&& comparable) noexcept {
-        auto result = node_t::extract(root_, std::forward<comparable_at>(comparable));
+        auto result = node_t::extract(root_, std::forward<comparable_at>(comparable), comparator());
         root_ = result.root;
         size_ -= result.extracted != nullptr;
         return extract_result_t {this, result.extracted.release()};
@@ -694,12 +941,97 @@ class avl_tree_gt {
         return !!extract(std::forward<comparable_at>(comparable));
     }
 
+    /**
+     * @brief Destroys the entry of a detached node and releases its memory.
+     * Trivially destructible entries skip the destructor entirely.
+     */
+    void destroy_node(node_t* node) noexcept {
+        if constexpr (!std::is_trivially_destructible<entry_t>())
+            node->entry.~entry_t();
+        if (!release_from_slab(node))
+            allocator_.deallocate(node, 1);
+    }
+
+    /**
+     * @brief Relocates the nodes, accepted by the @p movable predicate, among the first @p budget
+     * nodes, starting with the @p first one, into a new slab, in key order. Only `scattered` nodes
+     * are moved, so repeated passes over a defragmented tree copy nothing. Every relocation
+     * takes a descent from the root, so the whole call takes O(budget * log(size)) time.
+     * @param[out] error    Reason of the failure, like `out_of_memory_arena_k`.
+     * @return The first node, that wasn't visited, or `nullptr`, if the tree was visited up to the end.
+     */
+    template <typename predicate_at>
+    node_t* defragment(node_t* first, std::size_t budget, predicate_at&& movable, errc_t& error) noexcept {
+        // Count the nodes first, so that the slab is sized exactly.
+        std::size_t count = 0;
+        node_t* previous = nullptr;
+        node_t* last = first;
+        for (std::size_t visited = 0; last && visited != budget; ++visited) {
+            node_t* next = upper_bound(last->entry);
+            count += movable(last->entry) && scattered(previous, last, next);
+            previous = std::exchange(last, next);
+        }
+        if (!count)
+            return last;
+
+        slab_t slab {nullptr, count, count};
+        error = invoke_safely([&] {
+            slabs_.reserve(slabs_.size() + 1);
+            slab.begin = allocator_.allocate(count);
+        }).errc;
+        if (error != success_k)
+            return first;
+        std::less<node_t const*> less;
+        slabs_.insert(std::upper_bound(slabs_.begin(),
+                                       slabs_.end(),
+                                       slab,
+                                       [&](slab_t const& a, slab_t const& b) { return less(a.begin, b.begin); }),
+                      slab);
+
+        // Relocations only make other slabs sparser, so more nodes may qualify, than were counted.
+        // Addresses of the relocated nodes are only compared, and never dereferenced.
+        node_t* target = slab.begin;
+        node_t* const slab_end = slab.begin + count;
+        node_t* node = first;
+        previous = nullptr;
+        while (node != last) {
+            node_t* next = upper_bound(node->entry);
+            if (movable(node->entry) && scattered(previous, node, next)) {
+                if (target == slab_end)
+                    break;
+                relocate(node, target++);
+            }
+            previous = std::exchange(node, next);
+        }
+        return node;
+    }
+
+    /**
+     * @brief Average distance in bytes between the addresses of nodes, that are adjacent
+     * in key order. Random insertions and deletions scatter the nodes, growing it,
+     * while a defragmented tree reports about `sizeof(node_t)`.
+     */
+    std::size_t neighbor_distance() const noexcept {
+        std::size_t total = 0;
+        node_t const* previous = nullptr;
+        node_t::for_each_left_right(root_, [&](node_t* node) noexcept {
+            auto a = reinterpret_cast<std::uintptr_t>(previous), b = reinterpret_cast<std::uintptr_t>(node);
+            total += previous ? (a > b ? a - b : b - a) : 0;
+            previous = node;
+        });
+        return size_ > 1 ? total / (size_ - 1) : 0;
+    }
+
     void clear() noexcept {
-        node_t::for_each_bottom_up(root_, [&](node_t* node) noexcept { return allocator_.deallocate(node, 1); });
+        node_t::for_each_bottom_up(root_, [&](node_t* node) noexcept { destroy_node(node); });
         root_ = nullptr;
         size_ = 0;
     }
 
+    void shrink_to_fit() noexcept {
+        invoke_safely([&] { slabs_.shrink_to_fit(); });
+    }
+
     template <typename callback_at>
     void for_each(callback_at&& callback) noexcept {
         node_t::for_each_bottom_up(root_, [&](node_t* node) noexcept { callback(node->entry); });
@@ -707,7 +1039,7 @@ class avl_tree_gt {
 
     void merge(avl_tree_t& other) noexcept {
         node_t::for_each_bottom_up(other.root_, [&](node_t* node) noexcept {
-            auto result = node_t::insert(root_, node);
+            auto result = node_t::insert(root_, node, comparator());
             root_ = result.root;
             size_ += result.inserted;
         });
@@ -718,7 +1050,7 @@ class avl_tree_gt {
     void merge(extract_result_t other) noexcept {
         if (!other.node_ptr_)
             return;
-        auto result = node_t::insert(root_, other.release());
+        auto result = node_t::insert(root_, other.release(), comparator());
         root_ = result.root;
         size_ += result.inserted;
     }
@@ -744,19 +1076,46 @@ class avl_tree_gt {
  *      2. added in the second transaction.
  *      3. removed in the third transaction.
  * The first transaction will succeed, if we try to commit it.
+ *
+ * @section Tracing
+ * The @p tracer_at policy receives `find`, `range`, `upsert`, `stage`, `commit`
+ * and node allocation events. The default @c `no_tracer_t` compiles to nothing.
+ *
+ * @section Memory Budget
+ * Nodes and watches of the container and its transactions are charged to its own
+ * @c `memory_budget_t`. Past @c `limit_memory()`, the `upsert`, `stage` and batch
+ * operations fail with `out_of_memory_arena_k` before reaching the heap.
+ *
+ * @section Layout
+ * With @c `compact_layout_t`, the `deleted` and `visible` flags are folded into the
+ * high bits of the generation and, with a single-byte height, a node of 16-byte
+ * elements shrinks from 56 to 48 bytes. With @c `offset_links_t`, child links take
+ * 32 bits each, saving another 8 bytes per node, as long as all the nodes come
+ * from one contiguous @c `arena_t` reservation.
+ *
+ * @section Unversioned Mode
+ * With @c `unversioned_layout_t`, entries carry no generations or flags at all.
+ * The store becomes a plain AVL set: `upsert` replaces elements in place, `find`
+ * is a single descent, and `transaction()` fails to compile.
  */
 template < //
     typename element_at,
     typename comparator_at = std::less<element_at>,
-    typename allocator_at = std::allocator<std::uint8_t>>
+    typename allocator_at = std::allocator<std::uint8_t>,
+    typename tracer_at = no_tracer_t,
+    typename layout_at = padded_layout_t,
+    typename links_at = pointer_links_t>
 class consistent_avl_gt {
 
   public:
     using element_t = element_at;
     using comparator_t = comparator_at;
     using allocator_t = allocator_at;
+    using tracer_t = tracer_at;
+    using layout_t = layout_at;
+    using links_t = links_at;
 
-    using versioning_t = element_versioning_gt<element_t, comparator_t>;
+    using versioning_t = element_versioning_gt<element_t, comparator_t, layout_t>;
     using identifier_t = typename versioning_t::identifier_t;
     using generation_t = typename versioning_t::generation_t;
     using dated_identifier_t = typename versioning_t::dated_identifier_t;
@@ -765,15 +1124,23 @@ class consistent_avl_gt {
     using entry_t = typename versioning_t::entry_t;
     using entry_comparator_t = typename versioning_t::entry_comparator_t;
 
+    static constexpr bool versioned_k = !std::is_same<layout_t, unversioned_layout_t>();
+
   private:
-    using entry_node_t = avl_node_gt<entry_t, entry_comparator_t>;
-    using entry_allocator_t = typename allocator_t::template rebind<entry_node_t>::other;
-    using entry_set_t = avl_tree_gt<entry_t, entry_comparator_t, entry_allocator_t>;
+    using trace_scope_t = trace_scope_gt<tracer_t>;
+    using budgeted_allocator_t = budgeted_allocator_gt<allocator_t>;
+    using traced_allocator_t = traced_allocator_gt<budgeted_allocator_t, tracer_t>;
+    using entry_node_t = avl_node_gt<entry_t, entry_comparator_t, links_t>;
+    using entry_allocator_t = typename std::allocator_traits<traced_allocator_t>::template rebind_alloc<entry_node_t>;
+    using entry_set_t = avl_tree_gt<entry_t, entry_comparator_t, entry_allocator_t, links_t>;
     using entry_iterator_t = entry_node_t*;
 
-    using watches_allocator_t = typename allocator_t::template rebind<watched_identifier_t>::other;
+    using watches_allocator_t =
+        typename std::allocator_traits<traced_allocator_t>::template rebind_alloc<watched_identifier_t>;
     using watches_array_t = std::vector<watched_identifier_t, watches_allocator_t>;
     using watch_iterator_t = typename watches_array_t::iterator;
+    using staged_allocator_t = typename std::allocator_traits<traced_allocator_t>::template rebind_alloc<identifier_t>;
+    using staged_array_t = std::vector<identifier_t, staged_allocator_t>;
 
     using store_t = consistent_avl_gt;
     using extract_result_t = typename entry_set_t::extract_result_t;
@@ -789,17 +1156,34 @@ class consistent_avl_gt {
         };
 
         store_t* store_ {nullptr};
-        entry_set_t changes_ {};
-        watches_array_t watches_ {};
+        entry_set_t changes_;
+        watches_array_t watches_;
+        /// Keys of the changes merged into the container by `stage`, all dated with `generation_`.
+        staged_array_t staged_;
         generation_t generation_ {0};
         stage_t stage_ {stage_t::created_k};
+        /// Modification count of the container at the first `watch`.
+        std::size_t epoch_ {0};
         bool is_snapshot_ {false};
 
-        transaction_t(store_t& set) noexcept : store_(&set), generation_(set.new_generation()) {}
+        transaction_t(store_t& set) noexcept
+            : store_(&set), changes_(set.allocator<entry_allocator_t>(), set.entries_.comparator()),
+              watches_(set.allocator<watches_allocator_t>()),
+              staged_(set.allocator<staged_allocator_t>()), generation_(set.new_generation()) {}
         watch_t missing_watch() const noexcept { return watch_t {generation_, true}; }
         store_t& store_ref() noexcept { return *store_; }
         store_t const& store_ref() const noexcept { return *store_; }
 
+        /**
+         * @brief Grows the watches geometrically ahead of time, so that
+         * the following `push_back` can't throw inside a `noexcept` callback.
+         */
+        [[nodiscard]] status_t reserve_watch() noexcept {
+            if (watches_.size() != watches_.capacity())
+                return {success_k};
+            return invoke_safely([&] { watches_.reserve(std::max<std::size_t>(watches_.capacity() * 2, 16)); });
+        }
+
       public:
         transaction_t(transaction_t&&) noexcept = default;
         transaction_t& operator=(transaction_t&&) noexcept = default;
@@ -807,24 +1191,38 @@ class consistent_avl_gt {
         transaction_t& operator=(transaction_t const&) = delete;
         generation_t generation() const noexcept { return generation_; }
 
+        /**
+         * @brief Only transactions, that staged some changes, have entries in the container,
+         * so resetting, rolling back or committing others needs no container lock.
+         */
+        bool has_staged_entries() const noexcept { return stage_ == stage_t::staged_k && !staged_.empty(); }
+
+        /**
+         * @brief Transactions without changes only validate their watches in `stage`,
+         * never modifying the container, so a shared lock is enough.
+         */
+        bool read_only() const noexcept { return changes_.size() == 0; }
+
         [[nodiscard]] status_t upsert(element_t&& element) noexcept {
             entry_t entry;
             entry.element = std::move(element);
+            entry.refresh(store_ref().comparator());
             entry.generation = generation_;
             entry.deleted = false;
             entry.visible = false;
             auto result = changes_.upsert(std::move(entry));
-            return result.failed() ? status_t {out_of_memory_heap_k} : status_t {success_k};
+            return {result.errc};
         }
 
         [[nodiscard]] status_t erase(identifier_t const& id) noexcept {
             entry_t entry;
             entry.element = id;
+            entry.refresh(store_ref().comparator());
             entry.generation = generation_;
             entry.deleted = true;
             entry.visible = false;
             auto result = changes_.upsert(std::move(entry));
-            return result.failed() ? status_t {out_of_memory_heap_k} : status_t {success_k};
+            return {result.errc};
         }
 
         [[nodiscard]] status_t reserve(std::size_t size) noexcept {
@@ -832,6 +1230,10 @@ class consistent_avl_gt {
         }
 
         [[nodiscard]] status_t watch(identifier_t const& id) noexcept {
+            if (auto status = reserve_watch(); !status)
+                return status;
+            if (watches_.empty())
+                epoch_ = store_ref().epoch_;
             auto found = [&](entry_t const& entry) noexcept {
                 watches_.push_back({identifier_t {entry.element}, watch_t {entry.generation, entry.deleted}});
             };
@@ -842,6 +1244,10 @@ class consistent_avl_gt {
         }
 
         [[nodiscard]] status_t watch(entry_t const& entry) noexcept {
+            if (auto status = reserve_watch(); !status)
+                return status;
+            if (watches_.empty())
+                epoch_ = store_ref().epoch_;
             watches_.push_back({identifier_t {entry.element}, watch_t {entry.generation, entry.deleted}});
             return {success_k};
         }
@@ -852,7 +1258,8 @@ class consistent_avl_gt {
         [[nodiscard]] status_t find(comparable_at&& comparable,
                                     callback_found_at&& callback_found,
                                     callback_missing_at&& callback_missing = {}) const noexcept {
-            if (auto iterator = changes_.find(std::forward<comparable_at>(comparable)); iterator != changes_.end()) {
+            auto key = changes_.comparator().prefixed(comparable);
+            if (auto iterator = changes_.find(key); iterator != changes_.end()) {
                 !iterator->entry.deleted ? callback_found(iterator->entry) : callback_missing();
                 return {success_k};
             }
@@ -862,6 +1269,61 @@ class consistent_avl_gt {
                                         std::forward<callback_missing_at>(callback_missing));
         }
 
+        /**
+         * @brief Combines `find` and `watch`, recording the watch from the same lookup,
+         * that serves the read. Keys changed in this transaction are still watched
+         * in the container, but, like in `find`, served from the changes.
+         */
+        template <typename callback_found_at = no_op_t, typename callback_missing_at = no_op_t>
+        [[nodiscard]] status_t find_and_watch(identifier_t const& id,
+                                              callback_found_at&& callback_found,
+                                              callback_missing_at&& callback_missing = {}) noexcept {
+            if (auto status = reserve_watch(); !status)
+                return status;
+            auto& store = store_ref();
+            if (watches_.empty())
+                epoch_ = store.epoch_;
+
+            auto changed = changes_.find(changes_.comparator().prefixed(id));
+            bool const unchanged = changed == changes_.end();
+            auto found = [&](entry_t const& entry) {
+                watches_.push_back({identifier_t {entry.element}, watch_t {entry.generation, entry.deleted}});
+                if (unchanged)
+                    callback_found(entry);
+            };
+            auto missing = [&]() {
+                watches_.push_back({id, missing_watch()});
+                if (unchanged)
+                    callback_missing();
+            };
+            auto status = store.find(id, found, missing);
+            if (status && !unchanged)
+                !changed->entry.deleted ? callback_found(changed->entry) : callback_missing();
+            return status;
+        }
+
+        /**
+         * @brief Batched `find_and_watch`, that reserves the watches for all the keys at once.
+         * @param callback_missing  Receives the missing identifier.
+         */
+        template <typename keys_begin_at,
+                  typename keys_end_at = keys_begin_at,
+                  typename callback_found_at = no_op_t,
+                  typename callback_missing_at = no_op_t>
+        [[nodiscard]] status_t find_and_watch(keys_begin_at begin,
+                                              keys_end_at end,
+                                              callback_found_at&& callback_found,
+                                              callback_missing_at&& callback_missing) noexcept {
+            if (auto status = reserve(watches_.size() + std::distance(begin, end)); !status)
+                return status;
+            for (; begin != end; ++begin) {
+                identifier_t const& id = *begin;
+                if (auto status = find_and_watch(id, callback_found, [&] { callback_missing(id); }); !status)
+                    return status;
+            }
+            return {success_k};
+        }
+
         template <typename comparable_at = identifier_t,
                   typename callback_found_at = no_op_t,
                   typename callback_missing_at = no_op_t>
@@ -883,7 +1345,7 @@ class consistent_avl_gt {
                     return callback_found(external_element);
 
                 element_t const& internal_element = internal_iterator->entry;
-                if (!entry_comparator_t {}(external_element, internal_element))
+                if (!changes_.comparator()(external_element, internal_element))
                     return callback_found(internal_element);
 
                 // Check if this entry was deleted and we should try again.
@@ -917,37 +1379,46 @@ class consistent_avl_gt {
         }
 
         [[nodiscard]] status_t stage() noexcept {
+            trace_scope_t _ {trace_event_t::stage_k, static_cast<std::uint64_t>(generation_)};
+
             // First, check if we have any collisions.
+            // If nothing was modified since the first watch, none of them could collide.
             auto& store = store_ref();
             auto entry_missing = missing_watch();
-            for (auto const& id_and_watch : watches_) {
-                auto consistency_violated = false;
-                auto status = store.find(
-                    id_and_watch.id,
-                    [&](entry_t const& entry) noexcept { consistency_violated = entry != id_and_watch.watch; },
-                    [&]() noexcept { consistency_violated = entry_missing != id_and_watch.watch; });
-                if (consistency_violated)
-                    return {errc_t::consistency_k};
-                if (!status)
-                    return status;
-            }
+            bool const unmodified = !watches_.empty() && epoch_ == store.epoch_;
+            if (!unmodified)
+                for (auto const& id_and_watch : watches_) {
+                    auto consistency_violated = false;
+                    auto status = store.find(
+                        id_and_watch.id,
+                        [&](entry_t const& entry) noexcept { consistency_violated = entry != id_and_watch.watch; },
+                        [&]() noexcept { consistency_violated = entry_missing != id_and_watch.watch; });
+                    if (consistency_violated)
+                        return {errc_t::consistency_k};
+                    if (!status)
+                        return status;
+                }
 
-            // Now all of our watches will be replaced with "links" to entries
+            // Now all of our watches will be replaced with the keys of entries
             // we are merging into the main tree.
-            watches_.clear();
-            auto status = invoke_safely([&] { watches_.reserve(changes_.size()); });
+            if (read_only()) {
+                watches_.clear();
+                stage_ = stage_t::staged_k;
+                return {success_k};
+            }
+            auto status = invoke_safely([&] { staged_.reserve(changes_.size()); });
             if (!status)
                 return status;
 
             // No new memory allocations or failures are possible after that.
             // It is all safe.
-            changes_.for_each([&](entry_t const& entry) noexcept {
-                watches_.push_back({identifier_t {entry.element}, watch_t {generation_, entry.deleted}});
-            });
+            watches_.clear();
+            changes_.for_each([&](entry_t const& entry) noexcept { staged_.push_back(identifier_t {entry.element}); });
 
             // Than just merge our current nodes.
             // The visibility will be updated later in the `commit`.
             store.entries_.merge(changes_);
+            ++store.epoch_;
             stage_ = stage_t::staged_k;
             return {success_k};
         }
@@ -956,17 +1427,28 @@ class consistent_avl_gt {
             // If the transaction was "staged",
             // we must delete all the entries.
             auto& store = store_ref();
+            if (has_staged_entries())
+                ++store.epoch_;
             if (stage_ == stage_t::staged_k)
-                for (auto const& id_and_watch : watches_)
-                    store.entries_.erase(dated_identifier_t {id_and_watch.id, id_and_watch.watch.generation});
+                for (auto const& id : staged_)
+                    store.entries_.erase(dated_identifier_t {id, generation_});
 
             watches_.clear();
+            staged_.clear();
             changes_.clear();
             stage_ = stage_t::created_k;
             generation_ = store.new_generation();
             return {success_k};
         }
 
+        /**
+         * @brief Releases the unused capacity of the watches, kept across `reset`s.
+         * Like `std::vector::shrink_to_fit`, it's a non-binding request.
+         */
+        void shrink_to_fit() noexcept {
+            invoke_safely([&] { watches_.shrink_to_fit(), staged_.shrink_to_fit(); });
+        }
+
         [[nodiscard]] status_t rollback() noexcept {
             if (stage_ != stage_t::staged_k)
                 return {operation_not_permitted_k};
@@ -974,12 +1456,14 @@ class consistent_avl_gt {
             // If the transaction was "staged",
             // we must delete all the entries.
             auto& store = store_ref();
+            if (has_staged_entries())
+                ++store.epoch_;
             if (stage_ == stage_t::staged_k)
-                for (auto const& id_and_watch : watches_)
-                    changes_.merge(
-                        store.entries_.extract(dated_identifier_t {id_and_watch.id, id_and_watch.watch.generation}));
+                for (auto const& id : staged_)
+                    changes_.merge(store.entries_.extract(dated_identifier_t {id, generation_}));
 
             watches_.clear();
+            staged_.clear();
             stage_ = stage_t::created_k;
             generation_ = store.new_generation();
             return {success_k};
@@ -989,30 +1473,55 @@ class consistent_avl_gt {
             if (stage_ != stage_t::staged_k)
                 return {operation_not_permitted_k};
 
+            trace_scope_t _ {trace_event_t::commit_k, static_cast<std::uint64_t>(generation_)};
+
             // Once we make an entry visible,
             // if there are more than one with the same key,
             // the older generation must die.
+            // Later writes must get newer generations, than this one.
             auto& store = store_ref();
-            for (auto const& id_and_watch : watches_)
-                store.unmask_and_compact(id_and_watch.id, id_and_watch.watch.generation);
+            if (has_staged_entries()) {
+                ++store.epoch_;
+                store.generations_.raise(generation_);
+            }
+            for (auto const& id : staged_)
+                store.unmask_and_compact(id, generation_);
 
+            staged_.clear();
             stage_ = stage_t::created_k;
             return {success_k};
         }
     };
 
   private:
+    /// Must outlive the `entries_`, that release memory into it.
+    std::unique_ptr<memory_budget_t> budget_;
+    allocator_t allocator_;
     entry_set_t entries_;
-    generation_t generation_ {0};
     std::size_t visible_count_ {0};
+    /// Counts modifications, so that transactions can skip revalidating watches on an unchanged container.
+    std::size_t epoch_ {0};
+    /// Keeps the generations of writes growing, whichever thread they come from.
+    generation_floor_t generations_;
+    /// Entry, that the next `defragment` call resumes from, or none to start from the smallest key.
+    std::optional<dated_identifier_t> defragment_cursor_;
 
     friend class transaction_t;
-    generation_t new_generation() noexcept { return ++generation_; }
+    generation_t new_generation() const noexcept { return generations_.next(); }
+
+    consistent_avl_gt(allocator_t&& allocator, comparator_t const& comparator) noexcept
+        : budget_(new (std::nothrow) memory_budget_t), allocator_(std::move(allocator)),
+          entries_(this->allocator<entry_allocator_t>(), entry_comparator_t {comparator}) {}
+
+    template <typename rebound_allocator_at>
+    rebound_allocator_at allocator() const noexcept {
+        return rebound_allocator_at {traced_allocator_t {budgeted_allocator_t {allocator_, budget_.get()}}};
+    }
 
     void unmask_and_compact(identifier_t const& id, generation_t generation_to_unmask) noexcept {
         // This is similar to the public `erase_range()`, but adds generation-matching conditions.
         auto current = entries_.lower_bound(id);
-        auto less = entry_comparator_t {};
+        auto const& less = entries_.comparator();
         auto last_visible_entry = std::optional<dated_identifier_t> {};
         while (current && less.same(id, current->entry.element)) {
             auto next = entries_.upper_bound(current->entry);
@@ -1031,30 +1540,91 @@ class consistent_avl_gt {
     }
 
   public:
-    consistent_avl_gt() noexcept {}
     consistent_avl_gt(consistent_avl_gt&& other) noexcept
-        : entries_(std::move(other.entries_)), generation_(other.generation_), visible_count_(other.visible_count_) {}
+        : budget_(std::move(other.budget_)), allocator_(std::move(other.allocator_)),
+          entries_(std::move(other.entries_)), visible_count_(other.visible_count_), epoch_(other.epoch_),
+          generations_(other.generations_),
+          defragment_cursor_(std::move(other.defragment_cursor_)) {}
 
+    /**
+     * @brief Swaps the contents together with the budgets, so that
+     * the nodes are always released into the budget they were charged to.
+     */
     consistent_avl_gt& operator=(consistent_avl_gt&& other) noexcept {
+        std::swap(budget_, other.budget_);
+        std::swap(allocator_, other.allocator_);
         entries_ = std::move(other.entries_);
-        generation_ = other.generation_;
-        visible_count_ = other.visible_count_;
+        std::swap(visible_count_, other.visible_count_);
+        std::swap(epoch_, other.epoch_);
+        generations_.swap(other.generations_);
+        std::swap(defragment_cursor_, other.defragment_cursor_);
         return *this;
     }
 
     [[nodiscard]] std::size_t size() const noexcept { return entries_.size(); }
-    [[nodiscard]] static std::optional<store_t> make(allocator_t&& allocator = {}) noexcept { return store_t {}; }
-    [[nodiscard]] std::optional<transaction_t> transaction() noexcept { return transaction_t {*this}; }
+    [[nodiscard]] comparator_t const& comparator() const noexcept { return entries_.comparator().comparator(); }
+    [[nodiscard]] std::size_t memory_usage() const noexcept { return budget_->usage(); }
+    [[nodiscard]] std::size_t memory_limit() const noexcept { return budget_->limit(); }
+    void limit_memory(std::size_t bytes) noexcept { budget_->limit(bytes); }
+    void share_memory(memory_budget_t& shared) noexcept { budget_->share(shared); }
+
+    /**
+     * @brief Creates a new collection of this type without throwing exceptions.
+     * With @c `offset_links_t`, fails unless the allocator draws from a small enough
+     * `contiguous_bytes` reservation of an `arena_t`, as checked by `offset_links_t::admits`.
+     * @param allocator     Source of memory for the nodes, transactions and watches.
+     * @param comparator    Instance to be shared by all the comparisons, if it's stateful.
+     */
+    [[nodiscard]] static std::optional<store_t> make(allocator_t&& allocator = {},
+                                                     comparator_t const& comparator = {}) noexcept {
+        std::optional<store_t> result;
+        if (!links_t::admits(allocator))
+            return result;
+        if (store_t store {std::move(allocator), comparator}; store.budget_)
+            result.emplace(std::move(store));
+        return result;
+    }
+
+    /**
+     * @brief Starts a transaction with a new sequence number.
+     * If the memory budget is exhausted, an empty @c `std::optional` is returned.
+     */
+    [[nodiscard]] std::optional<transaction_t> transaction() noexcept {
+        static_assert(versioned_k, "Unversioned stores don't support transactions.");
+        if (budget_->exhausted())
+            return std::nullopt;
+        return transaction_t {*this};
+    }
 
     [[nodiscard]] status_t upsert(element_t&& element) noexcept {
-        auto node = entries_.allocator().allocate(1);
-        if (!node)
-            return {out_of_memory_heap_k};
+        trace_scope_t _ {trace_event_t::upsert_k};
+        ++epoch_;
+        if constexpr (!versioned_k) {
+            auto result = entries_.upsert(entry_t {std::move(element), comparator()});
+            visible_count_ += result.inserted;
+            return {result.errc};
+        }
 
+        // Without pending revisions of the same key, the entry is overwritten in place,
+        // skipping the allocation, the insertion and the compaction of older revisions.
         identifier_t id {element};
-        generation_t generation = new_generation();
+        if (entry_node_t* node = entry_node_t::find_unique(entries_.root(), entries_.comparator().prefixed(id), entries_.comparator());
+            node && node->entry.visible) {
+            node->entry.element = std::move(element);
+            node->entry.generation = generations_.next_write();
+            node->entry.deleted = false;
+            return {success_k};
+        }
+
+        errc_t errc = success_k;
+        auto node = entries_.allocate_node(errc);
+        if (!node)
+            return {errc};
+
+        generation_t generation = generations_.next_write();
         auto& entry = node->entry;
         new (&entry.element) element_t(std::move(element));
+        entry.refresh(comparator());
         entry.generation = generation;
         entry.deleted = false;
         entry.visible = true;
@@ -1066,6 +1636,8 @@ class consistent_avl_gt {
 
     template <typename elements_begin_at, typename elements_end_at = elements_begin_at>
     [[nodiscard]] status_t upsert(elements_begin_at begin, elements_end_at end) noexcept {
+        trace_scope_t _ {trace_event_t::upsert_k};
+        ++epoch_;
 
         // To make such batch insertions cheaper and easier until we have fast joins,
         // we can build a linked-list of pre-allocated nodes. Populate them and insert
@@ -1073,8 +1645,9 @@ class consistent_avl_gt {
         std::size_t const count = end - begin;
         std::size_t count_remaining = count;
         entry_node_t* last_node = nullptr;
+        errc_t errc = success_k;
         while (count_remaining) {
-            entry_node_t* next_node = entries_.allocator().allocate(1);
+            entry_node_t* next_node = entries_.allocate_node(errc);
             if (!next_node)
                 break;
             // Reset the state
@@ -1097,18 +1670,33 @@ class consistent_avl_gt {
                 last_node = prev_node;
                 ++count_remaining;
             }
-            return {out_of_memory_heap_k};
+            return {errc};
         }
 
         // Populate the allocated nodes and merge into the tree.
-        generation_t generation = new_generation();
+        generation_t generation = generations_.next_write();
         while (count_remaining != count) {
             entry_node_t* prev_node = last_node->left;
             last_node->left = nullptr;
             last_node->right = nullptr;
 
             auto& entry = last_node->entry;
-            new (&entry.element) element_t(*begin);
+            construct_from(entry.element, *begin);
+            entry.refresh(comparator());
+            if constexpr (!versioned_k) {
+                // Without generations, equal keys collide, so existing entries are overwritten in place.
+                if (entry_node_t* existing = entries_.find(entry); existing) {
+                    existing->entry.element = std::move(entry.element);
+                    entries_.destroy_node(last_node);
+                }
+                else
+                    entries_.merge(extract_result_t {&entries_, last_node}), ++visible_count_;
+                last_node = prev_node;
+                ++count_remaining;
+                ++begin;
+                continue;
+            }
+
             entry.generation = generation;
             entry.deleted = false;
             entry.visible = true;
@@ -1137,12 +1725,20 @@ class consistent_avl_gt {
                                 callback_found_at&& callback_found,
                                 callback_missing_at&& callback_missing = {}) const noexcept {
 
+        trace_scope_t _ {trace_event_t::find_k};
+        auto key = entries_.comparator().prefixed(comparable);
+        if constexpr (!versioned_k) {
+            entry_node_t* node = entry_node_t::find(entries_.root(), key, entries_.comparator());
+            node ? callback_found(node->entry) : callback_missing();
+            return {success_k};
+        }
+
         entry_node_t* largest_visible = nullptr;
-        entry_node_t::range(entries_.root(), comparable, comparable, [&](entry_node_t* node) noexcept {
+        entry_node_t::range(entries_.root(), key, key, [&](entry_node_t* node) noexcept {
             if ((node->entry.visible) &&
                 (!largest_visible || node->entry.generation > largest_visible->entry.generation))
                 largest_visible = node;
-        });
+        }, entries_.comparator());
 
         // static_assert(noexcept(callback_found(largest_visible->entry)));
         // static_assert(noexcept(callback_missing()));
@@ -1157,10 +1753,12 @@ class consistent_avl_gt {
                                        callback_found_at&& callback_found,
                                        callback_missing_at&& callback_missing = {}) const noexcept {
 
+        trace_scope_t _ {trace_event_t::upper_bound_k};
         // Skip all the invisible entries
-        entry_node_t* next_visible = entry_node_t::upper_bound(entries_.root(), comparable);
+        auto const& less = entries_.comparator();
+        entry_node_t* next_visible = entry_node_t::upper_bound(entries_.root(), less.prefixed(comparable), less);
         while (next_visible && !next_visible->entry.visible)
-            next_visible = entry_node_t::upper_bound(entries_.root(), next_visible->entry);
+            next_visible = entry_node_t::upper_bound(entries_.root(), next_visible->entry, less);
 
         // static_assert(noexcept(callback_found(next_visible->entry)));
         // static_assert(noexcept(callback_missing()));
@@ -1170,39 +1768,51 @@ class consistent_avl_gt {
 
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) const noexcept {
+        trace_scope_t _ {trace_event_t::range_k};
         entry_node_t::range(entries_.root(),
-                            std::forward<lower_at>(lower),
-                            std::forward<upper_at>(upper),
+                            entries_.comparator().prefixed(lower),
+                            entries_.comparator().prefixed(upper),
                             [&](entry_node_t* node) noexcept {
                                 if (node->entry.visible)
                                     callback(node->entry.element);
                                 static_assert(noexcept(callback(node->entry.element)));
-                            });
+                            },
+                            entries_.comparator());
         return {success_k};
     }
 
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) noexcept {
-        generation_t generation = new_generation();
+        trace_scope_t _ {trace_event_t::range_k};
+        ++epoch_;
+        if constexpr (!versioned_k)
+            return std::as_const(*this).range(std::forward<lower_at>(lower),
+                                              std::forward<upper_at>(upper),
+                                              std::forward<callback_at>(callback));
+
+        generation_t generation = generations_.next_write();
         entry_node_t::range(entries_.root(),
-                            std::forward<lower_at>(lower),
-                            std::forward<upper_at>(upper),
+                            entries_.comparator().prefixed(lower),
+                            entries_.comparator().prefixed(upper),
                             [&](entry_node_t* node) noexcept {
                                 if (node->entry.visible)
                                     callback(node->entry.element), node->entry.generation = generation;
                                 static_assert(noexcept(callback(node->entry.element)));
-                            });
+                            },
+                            entries_.comparator());
         return {success_k};
     }
 
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t erase_range(lower_at&& lower, upper_at&& upper, callback_at&& callback = {}) noexcept {
+        ++epoch_;
         // Implementing Splits and Joins for AVL can be tricky.
         // Let's start with deleting them one by one.
         // TODO: Implement range-removals.
-        auto last = entries_.lower_bound(std::forward<lower_at>(lower));
-        auto less = entry_comparator_t {};
-        while (last != entries_.end() && less(last->entry, upper)) {
+        auto last = entries_.lower_bound(entries_.comparator().prefixed(lower));
+        auto const& less = entries_.comparator();
+        auto upper_key = entries_.comparator().prefixed(upper);
+        while (last != entries_.end() && less(last->entry, upper_key)) {
             auto next = entries_.upper_bound(last->entry);
             if (last->entry.visible)
                 entries_.extract(last->entry);
@@ -1222,7 +1832,8 @@ class consistent_avl_gt {
             lower,
             upper,
             std::forward<generator_at>(generator),
-            [](entry_node_t* node) noexcept { return node->entry.visible; });
+            [](entry_node_t* node) noexcept { return node->entry.visible; },
+            entries_.comparator());
         if (node)
             callback(node->entry);
         return {success_k};
@@ -1257,11 +1868,55 @@ class consistent_avl_gt {
     }
 
     [[nodiscard]] status_t clear() noexcept {
+        ++epoch_;
         entries_.clear();
-        generation_ = 0;
         return {success_k};
     }
 
+    /**
+     * @brief Nodes are released as soon as their entries are erased, so only the bookkeeping
+     * of `defragment` slabs is left to release. Arena-backed containers can return the freed
+     * pages to the OS with `arena_t::trim()`.
+     * @return Number of bytes released from the memory budget of the container.
+     */
+    std::size_t shrink_to_fit() noexcept {
+        std::size_t usage = memory_usage();
+        entries_.shrink_to_fit();
+        return usage - memory_usage();
+    }
+
+    /**
+     * @brief Incrementally relocates the next @p budget nodes into a contiguous slab in key order,
+     * restoring the locality of scans after random insertions and deletions. Each call resumes,
+     * where the previous one stopped, wrapping around at the end, and takes O(budget * log(size)),
+     * so pauses stay bounded. Contents and watches are unaffected.
+     * Staged entries of transactions stay in place, as rollbacks move them back into transactions.
+     * @see `neighbor_distance()` to decide when to call it.
+     */
+    [[nodiscard]] status_t defragment(std::size_t budget) noexcept {
+        entry_node_t* first = entries_.root();
+        if (defragment_cursor_)
+            first = entries_.lower_bound(*defragment_cursor_);
+        else if (first)
+            first = entry_node_t::find_min(first);
+
+        errc_t errc = success_k;
+        auto movable = [](entry_t const& entry) noexcept { return static_cast<bool>(entry.visible); };
+        entry_node_t* next = entries_.defragment(first, budget, movable, errc);
+        if (errc != success_k)
+            return {errc};
+        defragment_cursor_.reset();
+        if (next)
+            defragment_cursor_.emplace(dated_identifier_t {identifier_t(next->entry.element), next->entry.generation});
+        return {success_k};
+    }
+
+    /**
+     * @brief Average distance in bytes between the addresses of nodes, adjacent in key order.
+     * Takes a full traversal, so it's meant for monitoring, rather than every request.
+     */
+    [[nodiscard]] std::size_t neighbor_distance() const noexcept { return entries_.neighbor_distance(); }
+
     template <typename dont_instantiate_me_at>
     void print(dont_instantiate_me_at& cout) {
         cout << "Items: " << entries_.size() << std::endl;
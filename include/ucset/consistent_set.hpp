@@ -1,35 +1,18 @@
 #pragma once
 #include <functional> // `std::less` as default
+#include <iterator>   // `std::distance`, `std::prev`
 #include <memory>     // `std::allocator` as default
 #include <optional>   // `std::optional` for "expected"
 #include <set>        // `std::set` for entries
 #include <vector>     // `std::vector` for watches
 #include <random>     // `std::uniform_int_distribution` fir sampling
 
+#include "allocators.hpp"
 #include "status.hpp"
+#include "tracing.hpp"
 
 namespace unum::ucset {
 
-template <typename callable_at>
-status_t invoke_safely(callable_at&& callable) noexcept {
-    if constexpr (noexcept(callable())) {
-        callable();
-        return {success_k};
-    }
-    else {
-        try {
-            callable();
-            return {success_k};
-        }
-        catch (std::bad_alloc const&) {
-            return {errc_t::out_of_memory_heap_k};
-        }
-        catch (...) {
-            return {errc_t::unknown_k};
-        }
-    }
-}
-
 /**
  * @brief Atomic (in DBMS and Set Theory sense) Transactional Store on top of a
  * Standard Templates Library. It can be used as a Key-Value store, if you store
@@ -44,22 +27,37 @@ status_t invoke_safely(callable_at&& callable) noexcept {
  *
  * @section Heterogeneous Comparisons
  *
+ * @section Memory Budget
+ *
+ * Every container charges all of its allocations, including the ones of its
+ * transactions, to its own @c `memory_budget_t`. Once @c `limit_memory()` is
+ * exceeded, modifications fail with `out_of_memory_arena_k`, leaving the heap
+ * for the rest of the process.
+ *
  * @tparam element_at
  * @tparam comparator_at
  * @tparam allocator_at
+ * @tparam tracer_at     Receives hot-path events. Compiles to nothing by default.
+ * @tparam layout_at     Pass @c `compact_layout_t` to pack the entry flags into the generation.
  */
 template < //
     typename element_at,
     typename comparator_at = std::less<element_at>,
-    typename allocator_at = std::allocator<std::uint8_t>>
-class consistent_set_gt {
+    typename allocator_at = std::allocator<std::uint8_t>,
+    typename tracer_at = no_tracer_t,
+    typename layout_at = padded_layout_t>
+class consistent_set_gt
+    : private functor_holder_gt<typename element_versioning_gt<element_at, comparator_at, layout_at>::entry_comparator_t> {
 
   public:
     using element_t = element_at;
     using comparator_t = comparator_at;
     using allocator_t = allocator_at;
+    using tracer_t = tracer_at;
+    using layout_t = layout_at;
 
-    using versioning_t = element_versioning_gt<element_t, comparator_t>;
+    using versioning_t = element_versioning_gt<element_t, comparator_t, layout_t>;
+    static_assert(!std::is_same<layout_t, unversioned_layout_t>(), "Use `consistent_avl_gt` for unversioned stores.");
     using identifier_t = typename versioning_t::identifier_t;
     using generation_t = typename versioning_t::generation_t;
     using dated_identifier_t = typename versioning_t::dated_identifier_t;
@@ -69,7 +67,11 @@ class consistent_set_gt {
     using entry_comparator_t = typename versioning_t::entry_comparator_t;
 
   private:
-    using entry_allocator_t = typename std::allocator_traits<allocator_t>::template rebind_alloc<entry_t>;
+    using entry_comparator_holder_t = functor_holder_gt<entry_comparator_t>;
+    using trace_scope_t = trace_scope_gt<tracer_t>;
+    using budgeted_allocator_t = budgeted_allocator_gt<allocator_t>;
+    using traced_allocator_t = traced_allocator_gt<budgeted_allocator_t, tracer_t>;
+    using entry_allocator_t = typename std::allocator_traits<traced_allocator_t>::template rebind_alloc<entry_t>;
     using entry_set_t = std::set< //
         entry_t,
         entry_comparator_t,
@@ -77,9 +79,67 @@ class consistent_set_gt {
     using entry_iterator_t = typename entry_set_t::iterator;
 
     using watches_allocator_t =
-        typename std::allocator_traits<allocator_t>::template rebind_alloc<watched_identifier_t>;
+        typename std::allocator_traits<traced_allocator_t>::template rebind_alloc<watched_identifier_t>;
     using watches_array_t = std::vector<watched_identifier_t, watches_allocator_t>;
     using watch_iterator_t = typename watches_array_t::iterator;
+    using staged_allocator_t = typename std::allocator_traits<traced_allocator_t>::template rebind_alloc<identifier_t>;
+    using staged_array_t = std::vector<identifier_t, staged_allocator_t>;
+
+    using node_t = typename entry_set_t::node_type;
+    using nodes_allocator_t = typename std::allocator_traits<traced_allocator_t>::template rebind_alloc<node_t>;
+    using nodes_array_t = std::vector<node_t, nodes_allocator_t>;
+
+    /**
+     * @brief Bounded stack of nodes, extracted from erased entries, that later insertions
+     * reuse, assigning the entries in place, instead of releasing and allocating them.
+     * Pooled nodes stay charged to the memory budget of the container, but their elements
+     * are reset to the empty state right away, releasing the resources they own.
+     */
+    class node_pool_t {
+        nodes_array_t nodes_;
+
+      public:
+        static constexpr std::size_t capacity_k = 64;
+
+        node_pool_t(nodes_allocator_t const& allocator) noexcept : nodes_(allocator) {}
+        std::size_t size() const noexcept { return nodes_.size(); }
+
+        /// Keeps the @p node, unless the pool is full, in which case it's released by the caller.
+        void recycle(node_t&& node) noexcept {
+            if (nodes_.size() == nodes_.capacity() &&
+                (nodes_.size() == capacity_k || !invoke_safely([&] { nodes_.reserve(capacity_k); })))
+                return;
+            if constexpr (!std::is_trivially_destructible<element_t>())
+                node.value().element = element_t {};
+            nodes_.push_back(std::move(node));
+        }
+
+        /// Recycles the nodes of the @p set, until the pool is full, releasing the rest.
+        void recycle(entry_set_t& set) noexcept {
+            while (!set.empty() && nodes_.size() != capacity_k)
+                recycle(set.extract(set.begin()));
+            set.clear();
+        }
+
+        /// Releases all the pooled nodes together with the pool itself.
+        void release() noexcept {
+            nodes_.clear();
+            invoke_safely([&] { nodes_.shrink_to_fit(); });
+        }
+
+        /**
+         * @brief Inserts the @p entry into the @p set, reusing a pooled node, if there is one.
+         * Like `emplace_hint`, returns the existing entry, if an equivalent one is present.
+         */
+        entry_iterator_t emplace_hint(entry_set_t& set, entry_iterator_t hint, entry_t&& entry) noexcept(false) {
+            if (nodes_.empty())
+                return set.emplace_hint(hint, std::move(entry));
+            node_t node = std::move(nodes_.back());
+            nodes_.pop_back();
+            node.value() = std::move(entry);
+            return set.insert(hint, std::move(node));
+        }
+    };
 
     using store_t = consistent_set_gt;
 
@@ -94,12 +154,22 @@ class consistent_set_gt {
         };
 
         store_t* store_ {nullptr};
-        entry_set_t changes_ {};
-        watches_array_t watches_ {};
+        entry_set_t changes_;
+        watches_array_t watches_;
+        /// Keys of the changes merged into the container by `stage`, all dated with `generation_`.
+        staged_array_t staged_;
+        /// Nodes of the changes, kept across `reset`s.
+        node_pool_t pool_;
         generation_t generation_ {0};
         stage_t stage_ {stage_t::created_k};
-
-        transaction_t(store_t& set) noexcept(false) : store_(&set), generation_(set.new_generation()) {}
+        /// Modification count of the container at the first `watch`.
+        std::size_t epoch_ {0};
+
+        transaction_t(store_t& set) noexcept(false)
+            : store_(&set), changes_(set.entry_comparator(), set.allocator<entry_allocator_t>()),
+              watches_(set.allocator<watches_allocator_t>()),
+              staged_(set.allocator<staged_allocator_t>()), pool_(set.allocator<nodes_allocator_t>()),
+              generation_(set.new_generation()) {}
         watch_t missing_watch() const noexcept { return watch_t {generation_, true}; }
         store_t& store_ref() noexcept { return *store_; }
         store_t const& store_ref() const noexcept { return *store_; }
@@ -111,11 +181,24 @@ class consistent_set_gt {
         transaction_t& operator=(transaction_t const&) = delete;
         generation_t generation() const noexcept { return generation_; }
 
+        /**
+         * @brief Only transactions, that staged some changes, have entries in the container,
+         * so resetting, rolling back or committing others needs no container lock.
+         */
+        bool has_staged_entries() const noexcept { return stage_ == stage_t::staged_k && !staged_.empty(); }
+
+        /**
+         * @brief Transactions without changes only validate their watches in `stage`,
+         * never modifying the container, so a shared lock is enough.
+         */
+        bool read_only() const noexcept { return changes_.empty(); }
+
         [[nodiscard]] status_t upsert(element_t&& element) noexcept {
             return invoke_safely([&] {
                 auto iterator = changes_.lower_bound(element);
-                if (iterator == changes_.end() || !entry_comparator_t {}.same(iterator->element, element))
-                    iterator = changes_.emplace_hint(iterator, std::move(element));
+                auto const& less = store_ref().entry_comparator();
+                if (iterator == changes_.end() || !less.same(iterator->element, element))
+                    iterator = pool_.emplace_hint(changes_, iterator, entry_t {std::move(element), less.comparator()});
                 else
                     iterator->element = std::move(element);
                 iterator->generation = generation_;
@@ -127,8 +210,9 @@ class consistent_set_gt {
         [[nodiscard]] status_t erase(identifier_t const& id) noexcept {
             return invoke_safely([&] {
                 auto iterator = changes_.lower_bound(id);
-                if (iterator == changes_.end() || !entry_comparator_t {}.same(iterator->element, id))
-                    iterator = changes_.emplace_hint(iterator, id);
+                auto const& less = store_ref().entry_comparator();
+                if (iterator == changes_.end() || !less.same(iterator->element, id))
+                    iterator = pool_.emplace_hint(changes_, iterator, entry_t {element_t(id), less.comparator()});
                 else
                     iterator->element = id;
                 iterator->generation = generation_;
@@ -142,6 +226,8 @@ class consistent_set_gt {
         }
 
         [[nodiscard]] status_t watch(identifier_t const& id) noexcept {
+            if (watches_.empty())
+                epoch_ = store_ref().epoch_;
             return store_ref().find(
                 id,
                 [&](entry_t const& entry) {
@@ -153,6 +239,8 @@ class consistent_set_gt {
         }
 
         [[nodiscard]] status_t watch(entry_t const& entry) noexcept {
+            if (watches_.empty())
+                epoch_ = store_ref().epoch_;
             return invoke_safely([&] {
                 watches_.push_back({identifier_t {entry.element}, watch_t {entry.generation, entry.deleted}});
             });
@@ -174,7 +262,7 @@ class consistent_set_gt {
         [[nodiscard]] status_t find(comparable_at&& comparable,
                                     callback_found_at&& callback_found,
                                     callback_missing_at&& callback_missing = {}) const noexcept {
-            if (auto iterator = changes_.find(std::forward<comparable_at>(comparable)); iterator != changes_.end())
+            if (auto iterator = changes_.find(store_ref().entry_comparator().prefixed(comparable)); iterator != changes_.end())
                 return !iterator->deleted ? invoke_safely([&callback_found, &iterator] { callback_found(*iterator); })
                                           : invoke_safely(callback_missing);
             else
@@ -183,6 +271,65 @@ class consistent_set_gt {
                                         std::forward<callback_missing_at>(callback_missing));
         }
 
+        /**
+         * @brief Combines `find` and `watch`, recording the watch from the same lookup,
+         *        that serves the read. Keys changed in this transaction are still watched
+         *        in the container, but, like in `find`, served from the changes.
+         *
+         * @param id                    Identifier to look up and watch.
+         * @param callback_found        Callback to receive an `element_t const &`. Ideally, `noexcept.`
+         * @param callback_missing      Callback to be triggered, if nothing was found.
+         */
+        template <typename callback_found_at = no_op_t, typename callback_missing_at = no_op_t>
+        [[nodiscard]] status_t find_and_watch(identifier_t const& id,
+                                              callback_found_at&& callback_found,
+                                              callback_missing_at&& callback_missing = {}) noexcept {
+            auto& store = store_ref();
+            if (watches_.empty())
+                epoch_ = store.epoch_;
+
+            auto changed = changes_.find(store.entry_comparator().prefixed(id));
+            bool const unchanged = changed == changes_.end();
+            auto status = store.find(
+                id,
+                [&](entry_t const& entry) {
+                    watches_.push_back({identifier_t {entry.element}, watch_t {entry.generation, entry.deleted}});
+                    if (unchanged)
+                        callback_found(entry);
+                },
+                [&] {
+                    watches_.push_back({id, missing_watch()});
+                    if (unchanged)
+                        callback_missing();
+                });
+            if (!status || unchanged)
+                return status;
+            return !changed->deleted ? invoke_safely([&] { callback_found(*changed); }) : invoke_safely(callback_missing);
+        }
+
+        /**
+         * @brief Batched `find_and_watch`, that reserves the watches for all the keys at once.
+         *
+         * @param callback_missing      Callback to receive the missing identifier.
+         */
+        template <typename keys_begin_at,
+                  typename keys_end_at = keys_begin_at,
+                  typename callback_found_at = no_op_t,
+                  typename callback_missing_at = no_op_t>
+        [[nodiscard]] status_t find_and_watch(keys_begin_at begin,
+                                              keys_end_at end,
+                                              callback_found_at&& callback_found,
+                                              callback_missing_at&& callback_missing) noexcept {
+            if (auto status = reserve(watches_.size() + std::distance(begin, end)); !status)
+                return status;
+            for (; begin != end; ++begin) {
+                identifier_t const& id = *begin;
+                if (auto status = find_and_watch(id, callback_found, [&] { callback_missing(id); }); !status)
+                    return status;
+            }
+            return {success_k};
+        }
+
         /**
          * @brief Finds the first member @b greater than the given @ref `comparable`.
          *        You may want to `watch()` the received object, it's not done by default.
@@ -214,7 +361,7 @@ class consistent_set_gt {
                     return callback_found(external_element);
 
                 element_t const& internal_element = internal_iterator->element;
-                if (!entry_comparator_t {}(external_element, internal_element))
+                if (!store_ref().entry_comparator()(external_element, internal_element))
                     return callback_found(internal_element);
 
                 // Check if this entry was deleted and we should try again.
@@ -247,36 +394,47 @@ class consistent_set_gt {
         }
 
         [[nodiscard]] status_t stage() noexcept {
+            trace_scope_t _ {trace_event_t::stage_k, static_cast<std::uint64_t>(generation_)};
+
             // First, check if we have any collisions.
+            // If nothing was modified since the first watch, none of them could collide.
             auto& store = store_ref();
             auto entry_missing = missing_watch();
-            for (auto const& id_and_watch : watches_) {
-                auto consistency_violated = false;
-                auto status = store.find(
-                    id_and_watch.id,
-                    [&](entry_t const& entry) noexcept { consistency_violated = entry != id_and_watch.watch; },
-                    [&]() noexcept { consistency_violated = entry_missing != id_and_watch.watch; });
-                if (consistency_violated)
-                    return {errc_t::consistency_k};
-                if (!status)
-                    return status;
-            }
+            bool const unmodified = !watches_.empty() && epoch_ == store.epoch_;
+            if (!unmodified)
+                for (auto const& id_and_watch : watches_) {
+                    auto consistency_violated = false;
+                    auto status = store.find(
+                        id_and_watch.id,
+                        [&](entry_t const& entry) noexcept { consistency_violated = entry != id_and_watch.watch; },
+                        [&]() noexcept { consistency_violated = entry_missing != id_and_watch.watch; });
+                    if (consistency_violated)
+                        return {errc_t::consistency_k};
+                    if (!status)
+                        return status;
+                }
 
-            // Now all of our watches will be replaced with "links" to entries
+            // Now all of our watches will be replaced with the keys of entries
             // we are merging into the main tree.
-            watches_.clear();
-            auto status = invoke_safely([&] { watches_.reserve(changes_.size()); });
+            if (read_only()) {
+                watches_.clear();
+                stage_ = stage_t::staged_k;
+                return {success_k};
+            }
+            auto status = invoke_safely([&] { staged_.reserve(changes_.size()); });
             if (!status)
                 return status;
 
             // No new memory allocations or failures are possible after that.
             // It is all safe.
+            watches_.clear();
             for (auto const& entry : changes_)
-                watches_.push_back({identifier_t {entry.element}, watch_t {generation_, entry.deleted}});
+                staged_.push_back(identifier_t {entry.element});
 
-            // Than just merge our current nodes.
+            // Than just merge our current nodes, walking both sorted sets at once.
             // The visibility will be updated later in the `commit`.
-            store.entries_.merge(changes_);
+            if (status = store.upsert(changes_); !status)
+                return status;
             stage_ = stage_t::staged_k;
             return {success_k};
         }
@@ -294,21 +452,33 @@ class consistent_set_gt {
             // If the transaction was "staged",
             // we must delete all the entries.
             auto& store = store_ref();
+            if (has_staged_entries())
+                ++store.epoch_;
             if (stage_ == stage_t::staged_k)
-                for (auto const& id_and_watch : watches_) {
+                for (auto const& id : staged_) {
                     // Heterogeneous `erase` is only coming in C++23.
-                    dated_identifier_t dated {id_and_watch.id, id_and_watch.watch.generation};
+                    dated_identifier_t dated {id, generation_};
                     if (auto iterator = store.entries_.find(dated); iterator != store.entries_.end())
-                        store.entries_.erase(iterator);
+                        store.pool_.recycle(store.entries_.extract(iterator));
                 }
 
             watches_.clear();
-            changes_.clear();
+            staged_.clear();
+            pool_.recycle(changes_);
             stage_ = stage_t::created_k;
             generation_ = store.new_generation();
             return {success_k};
         }
 
+        /**
+         * @brief Releases the unused capacity of the watches and the nodes pooled across `reset`s.
+         * Like `std::vector::shrink_to_fit`, it's a non-binding request.
+         */
+        void shrink_to_fit() noexcept {
+            invoke_safely([&] { watches_.shrink_to_fit(), staged_.shrink_to_fit(); });
+            pool_.release();
+        }
+
         /**
          * @brief Rolls-back a previously "staged" transaction.
          *
@@ -325,15 +495,18 @@ class consistent_set_gt {
             // If the transaction was "staged",
             // we must delete all the entries.
             auto& store = store_ref();
+            if (has_staged_entries())
+                ++store.epoch_;
             if (stage_ == stage_t::staged_k)
-                for (auto const& id_and_watch : watches_) {
-                    dated_identifier_t dated {id_and_watch.id, id_and_watch.watch.generation};
+                for (auto const& id : staged_) {
+                    dated_identifier_t dated {id, generation_};
                     auto source = store.entries_.find(dated);
                     auto node = store.entries_.extract(source);
                     changes_.insert(std::move(node));
                 }
 
             watches_.clear();
+            staged_.clear();
             stage_ = stage_t::created_k;
             generation_ = store.new_generation();
             return {success_k};
@@ -343,30 +516,54 @@ class consistent_set_gt {
             if (stage_ != stage_t::staged_k)
                 return {operation_not_permitted_k};
 
+            trace_scope_t _ {trace_event_t::commit_k, static_cast<std::uint64_t>(generation_)};
+
             // Once we make an entry visible,
             // if there are more than one with the same key,
             // the older generation must die.
+            // Later writes must get newer generations, than this one.
             auto& store = store_ref();
-            for (auto const& id_and_watch : watches_) {
-                auto range = store.entries_.equal_range(id_and_watch.id);
-                store.unmask_and_compact(range.first, range.second, id_and_watch.watch.generation);
+            if (has_staged_entries()) {
+                ++store.epoch_;
+                store.generations_.raise(generation_);
+            }
+            for (auto const& id : staged_) {
+                auto range = store.entries_.equal_range(id);
+                store.unmask_and_compact(range.first, range.second, generation_);
             }
 
+            staged_.clear();
             stage_ = stage_t::created_k;
             return {success_k};
         }
     };
 
   private:
+    /// Must outlive the `entries_`, that release memory into it.
+    std::unique_ptr<memory_budget_t> budget_;
+    allocator_t allocator_;
     entry_set_t entries_;
-    generation_t generation_ {0};
+    node_pool_t pool_;
     std::size_t visible_count_ {0};
+    /// Counts modifications, so that transactions can skip revalidating watches on an unchanged container.
+    std::size_t epoch_ {0};
     std::size_t visible_deleted_count_ {0};
+    /// Keeps the generations of writes growing, whichever thread they come from.
+    generation_floor_t generations_;
 
     friend class transaction_t;
 
-    consistent_set_gt() noexcept(false) {}
-    generation_t new_generation() noexcept { return ++generation_; }
+    consistent_set_gt(allocator_t&& allocator, comparator_t const& comparator) noexcept(false)
+        : entry_comparator_holder_t(entry_comparator_t {comparator}), budget_(std::make_unique<memory_budget_t>()),
+          allocator_(std::move(allocator)), entries_(entry_comparator(), this->allocator<entry_allocator_t>()),
+          pool_(this->allocator<nodes_allocator_t>()) {}
+    entry_comparator_t const& entry_comparator() const noexcept { return this->functor(); }
+    generation_t new_generation() const noexcept { return generations_.next(); }
+
+    template <typename rebound_allocator_at>
+    rebound_allocator_at allocator() const noexcept {
+        return rebound_allocator_at {traced_allocator_t {budgeted_allocator_t {allocator_, budget_.get()}}};
+    }
 
     template <typename callback_at = no_op_t>
     void erase_visible(entry_iterator_t begin, entry_iterator_t end, callback_at&& callback = {}) noexcept {
@@ -376,12 +573,38 @@ class consistent_set_gt {
                 callback(*current);
                 --visible_count_;
                 visible_deleted_count_ -= current->deleted;
-                current = entries_.erase(current);
+                pool_.recycle(entries_.extract(current++));
             }
             else
                 ++current;
     }
 
+    /**
+     * @brief Erases the visible revisions of the key at @p position, that precede it,
+     * stepping backwards instead of searching the tree for the first revision.
+     */
+    void erase_visible_before(entry_iterator_t position) noexcept {
+        auto const& less = entry_comparator();
+        auto range_start = position;
+        while (range_start != entries_.begin() && less.same(std::prev(range_start)->element, position->element))
+            --range_start;
+        erase_visible(range_start, position);
+    }
+
+    /**
+     * @brief Inserts a @p node, that doesn't precede the @p cursor, stepping forward
+     * a few entries to find its position, before searching the whole tree.
+     * Sorted batches landing into dense regions are inserted in amortized O(1).
+     */
+    entry_iterator_t insert_from(entry_iterator_t cursor, typename entry_set_t::node_type&& node) noexcept {
+        constexpr std::size_t steps_k = 8;
+        auto const& less = entries_.key_comp();
+        for (std::size_t step = 0; step != steps_k; ++step, ++cursor)
+            if (cursor == entries_.end() || less(node.value(), *cursor))
+                return entries_.insert(cursor, std::move(node));
+        return entries_.insert(std::move(node)).position;
+    }
+
     void unmask_and_compact(entry_iterator_t begin, entry_iterator_t end, generation_t generation_to_unmask) noexcept {
         entry_iterator_t& current = begin;
         entry_iterator_t last_visible_entry = end;
@@ -400,7 +623,7 @@ class consistent_set_gt {
             if (last_visible_entry != end) {
                 --visible_count_;
                 visible_deleted_count_ -= last_visible_entry->deleted;
-                entries_.erase(last_visible_entry);
+                pool_.recycle(entries_.extract(last_visible_entry));
             }
             last_visible_entry = current;
         }
@@ -421,41 +644,72 @@ class consistent_set_gt {
      * @return status_t        Can fail, if out of memory.
      */
     [[nodiscard]] status_t upsert(entry_set_t& sources) noexcept {
+        ++epoch_;
+        // Both sets are sorted, so every node is inserted after the previous one.
+        auto position = entries_.end();
         for (auto source = sources.begin(); source != sources.end();) {
             bool should_compact = source->visible;
             visible_count_ += source->visible;
             visible_deleted_count_ += source->visible && source->deleted;
             auto source_node = sources.extract(source++);
-            auto range_end = entries_.insert(std::move(source_node)).position;
-            if (should_compact) {
-                auto range_start = entries_.lower_bound(range_end->element);
-                erase_visible(range_start, range_end);
-            }
+            position = position == entries_.end() ? entries_.insert(std::move(source_node)).position
+                                                  : insert_from(position, std::move(source_node));
+            if (should_compact)
+                erase_visible_before(position);
         }
         return {success_k};
     }
 
   public:
+    consistent_set_gt(consistent_set_gt&&) noexcept = default;
+
+    /**
+     * @brief Swaps the contents together with the budgets, so that
+     * the nodes are always released into the budget they were charged to.
+     */
+    consistent_set_gt& operator=(consistent_set_gt&& other) noexcept {
+        std::swap(static_cast<entry_comparator_holder_t&>(*this), static_cast<entry_comparator_holder_t&>(other));
+        std::swap(budget_, other.budget_);
+        std::swap(allocator_, other.allocator_);
+        std::swap(entries_, other.entries_);
+        std::swap(pool_, other.pool_);
+        std::swap(visible_count_, other.visible_count_);
+        std::swap(visible_deleted_count_, other.visible_deleted_count_);
+        std::swap(epoch_, other.epoch_);
+        generations_.swap(other.generations_);
+        return *this;
+    }
+
     [[nodiscard]] std::size_t size() const noexcept { return visible_count_ - visible_deleted_count_; }
+    [[nodiscard]] comparator_t const& comparator() const noexcept { return entry_comparator().comparator(); }
     [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+    [[nodiscard]] std::size_t memory_usage() const noexcept { return budget_->usage(); }
+    [[nodiscard]] std::size_t memory_limit() const noexcept { return budget_->limit(); }
+    void limit_memory(std::size_t bytes) noexcept { budget_->limit(bytes); }
+    void share_memory(memory_budget_t& shared) noexcept { budget_->share(shared); }
 
     /**
      * @brief Creates a new collection of this type without throwing exceptions.
      * If fails, an empty @c `std::optional` is returned.
+     * @param allocator     Source of memory for the entries, transactions and watches.
+     * @param comparator    Instance to be shared by all the comparisons, if it's stateful.
      */
-    [[nodiscard]] static std::optional<store_t> make() noexcept {
+    [[nodiscard]] static std::optional<store_t> make(allocator_t&& allocator = {},
+                                                     comparator_t const& comparator = {}) noexcept {
         std::optional<store_t> result;
-        invoke_safely([&] { result.emplace(store_t {}); });
+        invoke_safely([&] { result.emplace(store_t {std::move(allocator), comparator}); });
         return result;
     }
 
     /**
      * @brief Starts a transaction with a new sequence number.
      * If succeeded, that transaction can later be reset to reuse the memory.
-     * If fails, an empty @c `std::optional` is returned.
+     * If fails or the memory budget is exhausted, an empty @c `std::optional` is returned.
      */
     [[nodiscard]] std::optional<transaction_t> transaction() noexcept {
         std::optional<transaction_t> result;
+        if (budget_->exhausted())
+            return result;
         invoke_safely([&] { result.emplace(transaction_t {*this}); });
         return result;
     }
@@ -469,17 +723,18 @@ class consistent_set_gt {
      * @return status_t     Can fail, if out of memory.
      */
     [[nodiscard]] status_t upsert(element_t&& element) noexcept {
-        generation_t generation = new_generation();
+        trace_scope_t _ {trace_event_t::upsert_k};
+        ++epoch_;
+        generation_t generation = generations_.next_write();
         return invoke_safely([&] {
             bool exists = static_cast<bool>(element);
-            auto entry = entry_t {std::move(element)};
+            auto entry = entry_t {std::move(element), comparator()};
             entry.generation = generation;
             entry.deleted = !exists;
             entry.visible = true;
-            auto range_end = entries_.insert(std::move(entry)).first;
-            auto range_start = entries_.lower_bound(range_end->element);
+            auto position = pool_.emplace_hint(entries_, entries_.end(), std::move(entry));
             ++visible_count_;
-            erase_visible(range_start, range_end);
+            erase_visible_before(position);
         });
     }
 
@@ -487,22 +742,23 @@ class consistent_set_gt {
      * @brief Atomically @b updates-or-inserts a batch of entries.
      * Either all entries will be inserted, or all will fail.
      *
-     * The dereferencing operator of the passed @param iterator
-     * should return R-Value references of @c `element_t`.
-     * @see `std::make_move_iterator()`.
+     * Elements are moved out of iterators, that yield R-Value references,
+     * like `std::make_move_iterator()`, and copied from all others.
      *
      * @param begin
      * @param end
      */
     template <typename elements_begin_at, typename elements_end_at = elements_begin_at>
     [[nodiscard]] status_t upsert(elements_begin_at begin, elements_end_at end) noexcept {
-        generation_t generation = new_generation();
+        trace_scope_t _ {trace_event_t::upsert_k};
+        ++epoch_;
+        generation_t generation = generations_.next_write();
         std::optional<entry_set_t> batch;
         auto batch_construction_status = invoke_safely([&] {
-            batch = entry_set_t {};
+            batch.emplace(entry_comparator(), allocator<entry_allocator_t>());
             for (; begin != end; ++begin) {
                 bool exists = static_cast<bool>(*begin);
-                auto iterator = batch->emplace(*begin).first;
+                auto iterator = pool_.emplace_hint(*batch, batch->end(), entry_t {element_from<element_t>(*begin), comparator()});
                 iterator->generation = generation;
                 iterator->visible = true;
                 iterator->deleted = !exists;
@@ -528,7 +784,8 @@ class consistent_set_gt {
                                 callback_found_at&& callback_found,
                                 callback_missing_at&& callback_missing = {}) const noexcept {
 
-        auto range = entries_.equal_range(std::forward<comparable_at>(comparable));
+        trace_scope_t _ {trace_event_t::find_k};
+        auto range = entries_.equal_range(entry_comparator().prefixed(comparable));
 
         // Skip all the invisible entries
         while (range.first != range.second && !range.first->visible)
@@ -554,7 +811,8 @@ class consistent_set_gt {
                                        callback_found_at&& callback_found,
                                        callback_missing_at&& callback_missing = {}) const noexcept {
 
-        auto iterator = entries_.upper_bound(std::forward<comparable_at>(comparable));
+        trace_scope_t _ {trace_event_t::upper_bound_k};
+        auto iterator = entries_.upper_bound(entry_comparator().prefixed(comparable));
 
         // Skip all the invisible entries
         while (iterator != entries_.end() && (!iterator->visible || iterator->deleted))
@@ -572,8 +830,9 @@ class consistent_set_gt {
      */
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) const noexcept {
-        auto lower_iterator = entries_.lower_bound(std::forward<lower_at>(lower));
-        auto const upper_iterator = entries_.lower_bound(std::forward<upper_at>(upper));
+        trace_scope_t _ {trace_event_t::range_k};
+        auto lower_iterator = entries_.lower_bound(entry_comparator().prefixed(lower));
+        auto const upper_iterator = entries_.lower_bound(entry_comparator().prefixed(upper));
         for (; lower_iterator != upper_iterator; ++lower_iterator)
             if (lower_iterator->visible && !lower_iterator->deleted)
                 if (auto status = invoke_safely([&] { callback(lower_iterator->element); }); !status)
@@ -589,9 +848,11 @@ class consistent_set_gt {
      */
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) noexcept {
-        generation_t generation = new_generation();
-        auto lower_iterator = entries_.lower_bound(std::forward<lower_at>(lower));
-        auto const upper_iterator = entries_.lower_bound(std::forward<upper_at>(upper));
+        trace_scope_t _ {trace_event_t::range_k};
+        ++epoch_;
+        generation_t generation = generations_.next_write();
+        auto lower_iterator = entries_.lower_bound(entry_comparator().prefixed(lower));
+        auto const upper_iterator = entries_.lower_bound(entry_comparator().prefixed(upper));
         for (; lower_iterator != upper_iterator; ++lower_iterator)
             if (lower_iterator->visible && !lower_iterator->deleted)
                 if (auto status = invoke_safely(
@@ -607,8 +868,9 @@ class consistent_set_gt {
      */
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t erase_range(lower_at&& lower, upper_at&& upper, callback_at&& callback) noexcept {
-        auto lower_iterator = entries_.lower_bound(std::forward<lower_at>(lower));
-        auto const upper_iterator = entries_.lower_bound(std::forward<upper_at>(upper));
+        ++epoch_;
+        auto lower_iterator = entries_.lower_bound(entry_comparator().prefixed(lower));
+        auto const upper_iterator = entries_.lower_bound(entry_comparator().prefixed(upper));
         erase_visible(lower_iterator, upper_iterator, std::forward<callback_at>(callback));
         return {success_k};
     }
@@ -617,13 +879,24 @@ class consistent_set_gt {
      * @brief Removes all the data from the container.
      */
     [[nodiscard]] status_t clear() noexcept {
+        ++epoch_;
         entries_.clear();
-        generation_ = 0;
         visible_count_ = 0;
         visible_deleted_count_ = 0;
         return {success_k};
     }
 
+    /**
+     * @brief Releases the pooled nodes, so that the memory of erased entries returns to the allocator.
+     * Arena-backed containers can then return the pages to the OS with `arena_t::trim()`.
+     * @return Number of bytes released from the memory budget of the container.
+     */
+    std::size_t shrink_to_fit() noexcept {
+        std::size_t usage = memory_usage();
+        pool_.release();
+        return usage - memory_usage();
+    }
+
     /**
      * @brief Optimization, that informs container to pre-allocate memory in-advance.
      * Doesn't guarantee, that the following "upserts" won't fail with "out of memory".
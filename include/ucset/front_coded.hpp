@@ -0,0 +1,532 @@
+#pragma once
+#include <algorithm>   // `std::upper_bound`, `std::stable_sort`
+#include <cstdint>     // `std::uint32_t`
+#include <cstring>     // `std::memcpy`
+#include <memory>      // `std::allocator_traits`
+#include <optional>    // `std::optional`
+#include <string_view> // `std::string_view`
+#include <utility>     // `std::exchange`
+#include <vector>      // `std::vector`
+
+#include "status.hpp"
+#include "tracing.hpp"
+#include "varlen.hpp"
+
+namespace unum::ucset {
+
+/**
+ * @brief Ordered store of string keys and values, packed into sorted blocks
+ * with front-coded keys: every entry keeps only the suffix, that differs from
+ * the previous key. Every @p restart_interval_ak entries the full key is stored
+ * again, marking a restart point for binary search. URL- and path-like keys
+ * with long shared prefixes shrink severalfold compared to per-node records.
+ *
+ * @section Semantics
+ * `find`, `upper_bound` and `range` behave like in `consistent_avl_gt`,
+ * with `range` including both bounds, and `erase_range` excluding the upper one.
+ * Keys are compared bytewise, like `varlen_compare_t` does.
+ *
+ * @section Decoding
+ * Reads decode entries lazily, reconstructing keys in a fixed buffer of
+ * @p max_key_ak bytes on the stack, so they never allocate. Longer keys
+ * are rejected with `invalid_argument_k`.
+ *
+ * @section Writes
+ * Every write rebuilds the blocks it touches aside, and swaps them in only
+ * once all the allocations have succeeded. Batches are sorted first, so each
+ * block is rebuilt once per batch. There are no transactions: revisions
+ * aren't kept, just like in the unversioned layout of `consistent_avl_gt`.
+ *
+ * @tparam block_bytes_ak       Nominal size of a block. Blocks grow up to twice that,
+ *                              before being split evenly, so that single upserts
+ *                              don't leave a trail of tiny blocks behind.
+ * @tparam restart_interval_ak  Number of entries between full keys.
+ */
+template <typename allocator_at = std::allocator<std::uint8_t>,
+          typename tracer_at = no_tracer_t,
+          std::size_t block_bytes_ak = 4096,
+          std::size_t restart_interval_ak = 16,
+          std::size_t max_key_ak = 1024>
+class front_coded_gt {
+
+  public:
+    using store_t = front_coded_gt;
+    using element_t = varlen_view_t;
+    using comparator_t = varlen_compare_t;
+    using identifier_t = std::string_view;
+    using allocator_t = allocator_at;
+    using tracer_t = tracer_at;
+    using trace_scope_t = trace_scope_gt<tracer_t>;
+
+    static constexpr std::size_t block_bytes_k = block_bytes_ak;
+    static constexpr std::size_t restart_interval_k = restart_interval_ak;
+    static constexpr std::size_t max_key_k = max_key_ak;
+    static_assert(restart_interval_k > 0, "Blocks need at least one restart point.");
+
+  private:
+    using allocator_traits_t = std::allocator_traits<allocator_t>;
+    using bytes_allocator_t = typename allocator_traits_t::template rebind_alloc<char>;
+    using offsets_allocator_t = typename allocator_traits_t::template rebind_alloc<std::uint32_t>;
+    using bytes_t = std::vector<char, bytes_allocator_t>;
+    using offsets_t = std::vector<std::uint32_t, offsets_allocator_t>;
+
+    struct block_t {
+        bytes_t bytes;
+        offsets_t restarts;
+        std::uint32_t count {0};
+
+        explicit block_t(allocator_t const& allocator)
+            : bytes(bytes_allocator_t(allocator)), restarts(offsets_allocator_t(allocator)) {}
+    };
+
+    using blocks_allocator_t = typename allocator_traits_t::template rebind_alloc<block_t>;
+    using blocks_t = std::vector<block_t, blocks_allocator_t>;
+
+    /**
+     * @brief Pending write of a batch: an upsert, or an erasure of the @p key.
+     */
+    struct change_t {
+        std::string_view key;
+        std::string_view value;
+        bool erase {false};
+    };
+
+    static void put_varint(bytes_t& bytes, std::size_t value) {
+        for (; value >= 0x80; value >>= 7)
+            bytes.push_back(static_cast<char>(value | 0x80));
+        bytes.push_back(static_cast<char>(value));
+    }
+
+    static std::size_t get_varint(char const*& cursor) noexcept {
+        std::size_t result = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            auto byte = static_cast<std::uint8_t>(*cursor++);
+            result |= std::size_t(byte & 0x7F) << shift;
+            if (byte < 0x80)
+                return result;
+        }
+    }
+
+    /**
+     * @brief Reads the full key at a restart point, without copying it.
+     */
+    static std::string_view restart_key(block_t const& block, std::uint32_t offset) noexcept {
+        char const* cursor = block.bytes.data() + offset;
+        get_varint(cursor); // Always zero shared bytes at restarts.
+        std::size_t unshared = get_varint(cursor);
+        get_varint(cursor);
+        return {cursor, unshared};
+    }
+
+    static std::string_view first_key(block_t const& block) noexcept { return restart_key(block, 0); }
+
+    /**
+     * @brief Decodes the entries of a block one by one, reconstructing
+     * the keys in a fixed buffer, so that reads never allocate.
+     */
+    class cursor_t {
+        block_t const* block_ {nullptr};
+        std::size_t offset_ {0};
+        std::size_t key_length_ {0};
+        std::string_view value_;
+        char key_[max_key_k];
+
+      public:
+        void seek(block_t const& block, std::size_t offset) noexcept {
+            block_ = &block;
+            offset_ = offset;
+            key_length_ = 0;
+        }
+
+        bool next() noexcept {
+            if (offset_ == block_->bytes.size())
+                return false;
+            char const* begin = block_->bytes.data() + offset_;
+            char const* cursor = begin;
+            std::size_t shared = get_varint(cursor);
+            std::size_t unshared = get_varint(cursor);
+            std::size_t value_length = get_varint(cursor);
+            std::memcpy(key_ + shared, cursor, unshared);
+            key_length_ = shared + unshared;
+            value_ = {cursor + unshared, value_length};
+            offset_ += cursor + unshared + value_length - begin;
+            return true;
+        }
+
+        std::string_view key() const noexcept { return {key_, key_length_}; }
+        std::string_view value() const noexcept { return value_; }
+        element_t element() const noexcept { return {key(), value_}; }
+    };
+
+    /**
+     * @brief Appends sorted entries to a block, and moves the block into
+     * the @p output once it reaches @p close_bytes, starting a new one.
+     */
+    class builder_t {
+        blocks_t& output_;
+        allocator_t const& allocator_;
+        std::size_t close_bytes_;
+        block_t block_;
+        char last_key_[max_key_k];
+        std::size_t last_length_ {0};
+
+      public:
+        builder_t(blocks_t& output, allocator_t const& allocator, std::size_t close_bytes)
+            : output_(output), allocator_(allocator), close_bytes_(close_bytes), block_(allocator) {}
+
+        void add(std::string_view key, std::string_view value) {
+            if (block_.bytes.size() >= close_bytes_)
+                flush();
+            std::size_t shared = 0;
+            if (block_.count % restart_interval_k == 0)
+                block_.restarts.push_back(static_cast<std::uint32_t>(block_.bytes.size()));
+            else
+                while (shared != last_length_ && shared != key.size() && last_key_[shared] == key[shared])
+                    ++shared;
+
+            put_varint(block_.bytes, shared);
+            put_varint(block_.bytes, key.size() - shared);
+            put_varint(block_.bytes, value.size());
+            block_.bytes.insert(block_.bytes.end(), key.begin() + shared, key.end());
+            block_.bytes.insert(block_.bytes.end(), value.begin(), value.end());
+            std::memcpy(last_key_ + shared, key.data() + shared, key.size() - shared);
+            last_length_ = key.size();
+            ++block_.count;
+        }
+
+        void flush() {
+            if (!block_.count)
+                return;
+            block_.bytes.shrink_to_fit();
+            block_.restarts.shrink_to_fit();
+            output_.push_back(std::move(block_));
+            block_ = block_t(allocator_);
+        }
+    };
+
+    allocator_t allocator_;
+    blocks_t blocks_;
+    std::size_t size_ {0};
+
+    explicit front_coded_gt(allocator_t&& allocator) noexcept
+        : allocator_(std::move(allocator)), blocks_(blocks_allocator_t(allocator_)) {}
+
+    /**
+     * @brief Index of the last block, that starts at or before the @p key, or zero.
+     */
+    std::size_t block_for(std::string_view key) const noexcept {
+        auto after = std::upper_bound(blocks_.begin(), blocks_.end(), key, [](std::string_view key, block_t const& block) {
+            return key < first_key(block);
+        });
+        return after == blocks_.begin() ? 0 : after - blocks_.begin() - 1;
+    }
+
+    /**
+     * @brief Positions the @p cursor on the first entry of the @p block, that isn't smaller,
+     * than the @p key. Binary searches through restart points, then decodes linearly.
+     * @return False, if all the keys in the block are smaller.
+     */
+    static bool seek_lower_bound(cursor_t& cursor, block_t const& block, std::string_view key) noexcept {
+        auto const& restarts = block.restarts;
+        auto after = std::upper_bound(restarts.begin(), restarts.end(), key, [&](std::string_view key, std::uint32_t offset) {
+            return key < restart_key(block, offset);
+        });
+        cursor.seek(block, after == restarts.begin() ? 0 : *(after - 1));
+        while (cursor.next())
+            if (!(cursor.key() < key))
+                return true;
+        return false;
+    }
+
+    /**
+     * @brief Positions the @p cursor on the first entry not smaller than @p key
+     * across all the blocks, keeping the index of the current block in @p block_idx.
+     */
+    bool seek_lower_bound(cursor_t& cursor, std::size_t& block_idx, std::string_view key) const noexcept {
+        if (blocks_.empty())
+            return false;
+        block_idx = block_for(key);
+        return seek_lower_bound(cursor, blocks_[block_idx], key) || next_block(cursor, block_idx);
+    }
+
+    bool next_block(cursor_t& cursor, std::size_t& block_idx) const noexcept {
+        while (++block_idx < blocks_.size()) {
+            cursor.seek(blocks_[block_idx], 0);
+            if (cursor.next())
+                return true;
+        }
+        return false;
+    }
+
+    bool next(cursor_t& cursor, std::size_t& block_idx) const noexcept {
+        return cursor.next() || next_block(cursor, block_idx);
+    }
+
+    /**
+     * @brief Merges the sorted and unique @p changes into the blocks, also dropping
+     * the keys in the `[drop_lower, drop_upper)` range. Only the affected blocks are
+     * rebuilt, aside from the live ones, so a failed allocation changes nothing.
+     */
+    status_t rewrite(change_t const* changes,
+                     std::size_t changes_count,
+                     std::string_view drop_lower = {},
+                     std::string_view drop_upper = {}) noexcept {
+
+        for (std::size_t change_idx = 0; change_idx != changes_count; ++change_idx)
+            if (changes[change_idx].key.size() > max_key_k)
+                return {invalid_argument_k};
+
+        bool const drops = drop_lower < drop_upper;
+        auto dropped = [&](std::string_view key) noexcept {
+            return drops && !(key < drop_lower) && key < drop_upper;
+        };
+
+        // Spans of the `fresh` blocks replacing every affected block.
+        struct replacement_t {
+            std::size_t block_idx;
+            std::size_t fresh_begin;
+            std::size_t fresh_end;
+        };
+
+        blocks_t fresh {blocks_allocator_t(allocator_)};
+        using replacements_allocator_t = typename allocator_traits_t::template rebind_alloc<replacement_t>;
+        std::vector<replacement_t, replacements_allocator_t> replacements {replacements_allocator_t(allocator_)};
+        std::ptrdiff_t size_delta = 0;
+        cursor_t cursor;
+
+        auto status = invoke_safely([&] {
+            std::size_t change_idx = 0;
+            std::size_t const blocks_count = std::max<std::size_t>(blocks_.size(), 1);
+            for (std::size_t block_idx = 0; block_idx != blocks_count; ++block_idx) {
+                block_t const* block = blocks_.empty() ? nullptr : &blocks_[block_idx];
+                bool const last = block_idx + 1 == blocks_count;
+                std::string_view block_end = last ? std::string_view {} : first_key(blocks_[block_idx + 1]);
+                auto before_end = [&](std::string_view key) noexcept { return last || key < block_end; };
+
+                std::size_t changes_end = change_idx;
+                while (changes_end != changes_count && before_end(changes[changes_end].key))
+                    ++changes_end;
+                bool const overlaps_drop = drops && block && before_end(drop_lower) && first_key(*block) < drop_upper;
+                if (changes_end == change_idx && !overlaps_drop)
+                    continue;
+
+                // Split evenly, only if the block outgrows twice the nominal size.
+                std::size_t estimate = block ? block->bytes.size() : 0;
+                for (std::size_t idx = change_idx; idx != changes_end; ++idx)
+                    estimate += changes[idx].key.size() + changes[idx].value.size() + 3;
+                std::size_t const parts = estimate <= 2 * block_bytes_k ? 1 : (estimate + block_bytes_k - 1) / block_bytes_k;
+
+                std::size_t fresh_begin = fresh.size();
+                builder_t builder {fresh, allocator_, parts == 1 ? estimate + 1 : estimate / parts};
+                bool has_entry = false;
+                if (block)
+                    cursor.seek(*block, 0), has_entry = cursor.next();
+                while (has_entry || change_idx != changes_end) {
+                    bool const take_entry =
+                        has_entry && (change_idx == changes_end || cursor.key() < changes[change_idx].key);
+                    if (take_entry) {
+                        if (dropped(cursor.key()))
+                            --size_delta;
+                        else
+                            builder.add(cursor.key(), cursor.value());
+                        has_entry = cursor.next();
+                        continue;
+                    }
+
+                    change_t const& change = changes[change_idx++];
+                    bool const replaces = has_entry && cursor.key() == change.key;
+                    if (replaces)
+                        has_entry = cursor.next();
+                    if (!change.erase)
+                        builder.add(change.key, change.value);
+                    size_delta += (change.erase ? 0 : 1) - (replaces ? 1 : 0);
+                }
+                builder.flush();
+                replacements.push_back({block_idx, fresh_begin, fresh.size()});
+            }
+        });
+        if (!status)
+            return status;
+        if (replacements.empty())
+            return {success_k};
+
+        blocks_t result {blocks_allocator_t(allocator_)};
+        status = invoke_safely([&] { result.reserve(blocks_.size() + fresh.size()); });
+        if (!status)
+            return status;
+
+        // From here on, only moves happen, which can't fail.
+        auto replacement = replacements.begin();
+        for (std::size_t block_idx = 0; block_idx != std::max<std::size_t>(blocks_.size(), 1); ++block_idx) {
+            if (replacement != replacements.end() && replacement->block_idx == block_idx) {
+                for (std::size_t fresh_idx = replacement->fresh_begin; fresh_idx != replacement->fresh_end; ++fresh_idx)
+                    result.push_back(std::move(fresh[fresh_idx]));
+                ++replacement;
+            }
+            else
+                result.push_back(std::move(blocks_[block_idx]));
+        }
+        blocks_ = std::move(result);
+        size_ += size_delta;
+        return {success_k};
+    }
+
+  public:
+    front_coded_gt(front_coded_gt&& other) noexcept
+        : allocator_(std::move(other.allocator_)), blocks_(std::move(other.blocks_)),
+          size_(std::exchange(other.size_, 0)) {}
+
+    front_coded_gt& operator=(front_coded_gt&& other) noexcept {
+        std::swap(allocator_, other.allocator_);
+        std::swap(blocks_, other.blocks_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return !size_; }
+    [[nodiscard]] std::size_t blocks() const noexcept { return blocks_.size(); }
+
+    /**
+     * @brief Bytes allocated for the blocks, their restart points and the index.
+     */
+    [[nodiscard]] std::size_t memory_usage() const noexcept {
+        std::size_t total = blocks_.capacity() * sizeof(block_t);
+        for (auto const& block : blocks_)
+            total += block.bytes.capacity() + block.restarts.capacity() * sizeof(std::uint32_t);
+        return total;
+    }
+
+    [[nodiscard]] static std::optional<store_t> make(allocator_t&& allocator = {}) noexcept {
+        return store_t {std::move(allocator)};
+    }
+
+    [[nodiscard]] status_t upsert(element_t&& element) noexcept {
+        trace_scope_t _ {trace_event_t::upsert_k};
+        change_t change {element.key(), element.value()};
+        return rewrite(&change, 1);
+    }
+
+    /**
+     * @brief Upserts a batch of records with `key()` and `value()` members, like `varlen_gt`,
+     * rebuilding every affected block once. If the same key repeats, the last record wins.
+     */
+    template <typename elements_begin_at, typename elements_end_at = elements_begin_at>
+    [[nodiscard]] status_t upsert(elements_begin_at begin, elements_end_at end) noexcept {
+        trace_scope_t _ {trace_event_t::upsert_k};
+        using changes_allocator_t = typename allocator_traits_t::template rebind_alloc<change_t>;
+        std::vector<change_t, changes_allocator_t> changes {changes_allocator_t(allocator_)};
+        auto status = invoke_safely([&] {
+            changes.reserve(end - begin);
+            for (; begin != end; ++begin)
+                changes.push_back({begin->key(), begin->value()});
+        });
+        if (!status)
+            return status;
+
+        auto less = [](change_t const& a, change_t const& b) noexcept { return a.key < b.key; };
+        std::stable_sort(changes.begin(), changes.end(), less);
+        auto last_of_each = std::unique(changes.rbegin(), changes.rend(), [](change_t const& a, change_t const& b) {
+            return a.key == b.key;
+        });
+        changes.erase(changes.begin(), last_of_each.base());
+        return rewrite(changes.data(), changes.size());
+    }
+
+    [[nodiscard]] status_t erase(identifier_t const& id) noexcept {
+        trace_scope_t _ {trace_event_t::upsert_k};
+        change_t change {id, {}, true};
+        return rewrite(&change, 1);
+    }
+
+    template <typename comparable_at = identifier_t,
+              typename callback_found_at = no_op_t,
+              typename callback_missing_at = no_op_t>
+    [[nodiscard]] status_t find(comparable_at&& comparable,
+                                callback_found_at&& callback_found,
+                                callback_missing_at&& callback_missing = {}) const noexcept {
+        trace_scope_t _ {trace_event_t::find_k};
+        std::string_view key(comparable);
+        cursor_t cursor;
+        std::size_t block_idx = 0;
+        bool found = seek_lower_bound(cursor, block_idx, key) && cursor.key() == key;
+        found ? callback_found(cursor.element()) : callback_missing();
+        return {success_k};
+    }
+
+    template <typename comparable_at = identifier_t,
+              typename callback_found_at = no_op_t,
+              typename callback_missing_at = no_op_t>
+    [[nodiscard]] status_t upper_bound(comparable_at&& comparable,
+                                       callback_found_at&& callback_found,
+                                       callback_missing_at&& callback_missing = {}) const noexcept {
+        trace_scope_t _ {trace_event_t::upper_bound_k};
+        std::string_view key(comparable);
+        cursor_t cursor;
+        std::size_t block_idx = 0;
+        bool found = seek_lower_bound(cursor, block_idx, key);
+        if (found && cursor.key() == key)
+            found = next(cursor, block_idx);
+        found ? callback_found(cursor.element()) : callback_missing();
+        return {success_k};
+    }
+
+    /**
+     * @brief Visits all the records with keys in the `[lower, upper]` range in sorted order,
+     * decoding them lazily, block by block.
+     */
+    template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
+    [[nodiscard]] status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) const noexcept {
+        trace_scope_t _ {trace_event_t::range_k};
+        std::string_view upper_key(upper);
+        cursor_t cursor;
+        std::size_t block_idx = 0;
+        for (bool found = seek_lower_bound(cursor, block_idx, std::string_view(lower));
+             found && !(upper_key < cursor.key());
+             found = next(cursor, block_idx))
+            callback(cursor.element());
+        return {success_k};
+    }
+
+    /**
+     * @brief Removes all the records with keys in the `[lower, upper)` range,
+     * passing them to the @p callback first. If rebuilding the blocks fails,
+     * nothing is removed, but the callback has already seen the records.
+     */
+    template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
+    [[nodiscard]] status_t erase_range(lower_at&& lower, upper_at&& upper, callback_at&& callback = {}) noexcept {
+        std::string_view lower_key(lower), upper_key(upper);
+        if (!(lower_key < upper_key))
+            return {success_k};
+        if constexpr (!std::is_same<std::decay_t<callback_at>, no_op_t>()) {
+            cursor_t cursor;
+            std::size_t block_idx = 0;
+            for (bool found = seek_lower_bound(cursor, block_idx, lower_key); found && cursor.key() < upper_key;
+                 found = next(cursor, block_idx))
+                callback(cursor.element());
+        }
+        return rewrite(nullptr, 0, lower_key, upper_key);
+    }
+
+    [[nodiscard]] status_t clear() noexcept {
+        blocks_.clear();
+        size_ = 0;
+        return {success_k};
+    }
+
+    /**
+     * @brief Reallocates the blocks and the index to their exact sizes, if memory allows.
+     * @return Number of bytes released, as reported by `memory_usage()`.
+     */
+    std::size_t shrink_to_fit() noexcept {
+        std::size_t usage = memory_usage();
+        invoke_safely([&] {
+            for (auto& block : blocks_)
+                block.bytes.shrink_to_fit(), block.restarts.shrink_to_fit();
+            blocks_.shrink_to_fit();
+        });
+        return usage - memory_usage();
+    }
+};
+
+} // namespace unum::ucset
@@ -0,0 +1,220 @@
+#pragma once
+#include <array>  // `std::array` for buckets
+#include <atomic> // `std::atomic` for shared counters
+#include <chrono> // `std::chrono::steady_clock` as a fallback timer
+#include <memory> // `std::unique_ptr` for shards
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // `__rdtsc`
+#endif
+
+#include "status.hpp"
+
+namespace unum::ucset {
+
+/**
+ * @brief Public operations, whose latencies can be collected.
+ * Ranges and batch upserts are normalized by the number of elements.
+ */
+enum class latency_operation_t : std::uint8_t {
+    find_k,
+    upper_bound_k,
+    range_per_element_k,
+    upsert_k,
+    upsert_batch_per_element_k,
+    stage_k,
+    commit_k,
+};
+
+constexpr std::size_t latency_operations_k = 7;
+
+/**
+ * @brief Reads the cheapest monotonic CPU counter available.
+ * On x86 it is the Time Stamp Counter, on AArch64 the virtual counter,
+ * elsewhere - nanoseconds of the `std::chrono::steady_clock`.
+ */
+inline std::uint64_t cpu_ticks() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    std::uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+#endif
+}
+
+/**
+ * @brief HDR-style log-linear histogram of tick counts.
+ * Every power-of-two range is split into 8 linear sub-buckets,
+ * so any recorded value is off by at most 12.5%.
+ */
+struct latency_histogram_t {
+    static constexpr std::size_t precision_bits_k = 3;
+    static constexpr std::size_t sub_buckets_k = 1ul << precision_bits_k;
+    static constexpr std::size_t buckets_k = sub_buckets_k + (64 - precision_bits_k) * sub_buckets_k;
+
+    std::array<std::uint64_t, buckets_k> counts {};
+
+    static std::size_t bucket(std::uint64_t ticks) noexcept {
+        if (ticks < sub_buckets_k)
+            return ticks;
+        std::size_t magnitude = 63 - __builtin_clzll(ticks);
+        std::size_t sub_bucket = (ticks >> (magnitude - precision_bits_k)) & (sub_buckets_k - 1);
+        return sub_buckets_k + (magnitude - precision_bits_k) * sub_buckets_k + sub_bucket;
+    }
+
+    /**
+     * @return The smallest value, that falls into the given @p bucket.
+     */
+    static std::uint64_t bucket_floor(std::size_t bucket) noexcept {
+        if (bucket < sub_buckets_k)
+            return bucket;
+        std::size_t magnitude = (bucket - sub_buckets_k) / sub_buckets_k + precision_bits_k;
+        std::size_t sub_bucket = (bucket - sub_buckets_k) % sub_buckets_k;
+        return std::uint64_t(sub_buckets_k + sub_bucket) << (magnitude - precision_bits_k);
+    }
+
+    std::uint64_t count() const noexcept {
+        std::uint64_t total = 0;
+        for (auto count : counts)
+            total += count;
+        return total;
+    }
+
+    /**
+     * @param quantile  Number between zero and one, like 0.99 for the 99th percentile.
+     * @return Lower bound of the bucket, where the requested quantile lies.
+     */
+    std::uint64_t percentile(double quantile) const noexcept {
+        std::uint64_t threshold = static_cast<std::uint64_t>(quantile * count());
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket != buckets_k; ++bucket)
+            if (seen += counts[bucket]; seen > threshold)
+                return bucket_floor(bucket);
+        return max();
+    }
+
+    std::uint64_t max() const noexcept {
+        for (std::size_t bucket = buckets_k; bucket != 0; --bucket)
+            if (counts[bucket - 1])
+                return bucket_floor(bucket - 1);
+        return 0;
+    }
+
+    latency_histogram_t& operator+=(latency_histogram_t const& other) noexcept {
+        for (std::size_t bucket = 0; bucket != buckets_k; ++bucket)
+            counts[bucket] += other.counts[bucket];
+        return *this;
+    }
+};
+
+/**
+ * @brief Default policy, that collects nothing and costs nothing.
+ */
+struct no_latencies_t {
+    static constexpr bool enabled_k = false;
+    void record(latency_operation_t, std::uint64_t) noexcept {}
+    latency_histogram_t merged(latency_operation_t) const noexcept { return {}; }
+    void reset() noexcept {}
+};
+
+/**
+ * @brief Collects per-operation latency histograms into a fixed number of shards.
+ *
+ * Every thread is pinned to a shard on the first record, round-robin. With no
+ * more threads than shards, every cache line has a single writer, so relaxed
+ * increments stay uncontended. Beyond that, threads share shards, but no records
+ * are lost. Shards are merged on read. If they can't be allocated, nothing is recorded.
+ *
+ * @tparam shards_ak    Number of independent histogram sets.
+ */
+template <std::size_t shards_ak = 8>
+class latency_histograms_gt {
+  public:
+    static constexpr bool enabled_k = true;
+    static constexpr std::size_t shards_k = shards_ak;
+    static constexpr std::size_t buckets_k = latency_histogram_t::buckets_k;
+
+  private:
+    using counter_t = std::atomic<std::uint64_t>;
+    struct alignas(64) shard_t {
+        std::array<std::array<counter_t, buckets_k>, latency_operations_k> counts;
+    };
+
+    std::unique_ptr<shard_t[]> shards_;
+
+    static std::size_t thread_shard() noexcept {
+        static std::atomic<std::size_t> threads {0};
+        thread_local std::size_t shard = threads.fetch_add(1, std::memory_order_relaxed) % shards_k;
+        return shard;
+    }
+
+  public:
+    latency_histograms_gt() noexcept : shards_(new (std::nothrow) shard_t[shards_k]()) {}
+    latency_histograms_gt(latency_histograms_gt&&) noexcept = default;
+    latency_histograms_gt& operator=(latency_histograms_gt&&) noexcept = default;
+
+    void record(latency_operation_t operation, std::uint64_t ticks) noexcept {
+        if (!shards_)
+            return;
+        auto& counter = shards_[thread_shard()].counts[static_cast<std::size_t>(operation)][
+            latency_histogram_t::bucket(ticks)];
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    latency_histogram_t merged(latency_operation_t operation) const noexcept {
+        latency_histogram_t result;
+        if (!shards_)
+            return result;
+        for (std::size_t shard = 0; shard != shards_k; ++shard) {
+            auto const& counts = shards_[shard].counts[static_cast<std::size_t>(operation)];
+            for (std::size_t bucket = 0; bucket != buckets_k; ++bucket)
+                result.counts[bucket] += counts[bucket].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    void reset() noexcept {
+        if (!shards_)
+            return;
+        for (std::size_t shard = 0; shard != shards_k; ++shard)
+            for (auto& counts : shards_[shard].counts)
+                for (auto& counter : counts)
+                    counter.store(0, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief RAII helper, that measures the lifetime of a scope and records it,
+ * optionally divided by the number of processed elements.
+ * Doesn't even read the clock, if the @p latencies_at policy is disabled.
+ */
+template <typename latencies_at>
+class latency_scope_gt {
+    latencies_at& latencies_;
+    latency_operation_t operation_;
+    std::uint64_t start_ {0};
+    std::size_t elements_ {1};
+
+  public:
+    latency_scope_gt(latencies_at& latencies, latency_operation_t operation) noexcept
+        : latencies_(latencies), operation_(operation) {
+        if constexpr (latencies_at::enabled_k)
+            start_ = cpu_ticks();
+    }
+
+    ~latency_scope_gt() noexcept {
+        if constexpr (latencies_at::enabled_k)
+            latencies_.record(operation_, (cpu_ticks() - start_) / (elements_ ? elements_ : 1));
+    }
+
+    latency_scope_gt(latency_scope_gt const&) = delete;
+    latency_scope_gt& operator=(latency_scope_gt const&) = delete;
+
+    void elements(std::size_t count) noexcept { elements_ = count; }
+};
+
+} // namespace unum::ucset
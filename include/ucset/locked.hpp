@@ -1,14 +1,27 @@
 #pragma once
+#include <iterator>     // `std::distance`
 #include <shared_mutex> // `std::shared_mutex`
 
+#include "latencies.hpp"
+#include "tracing.hpp"
+
 namespace unum::ucset {
 
 /**
  * @brief Wraps and protects any "Consistent Set" under a shared mutex.
  * The collection itself becomes @b thread-safe, but the transaction don't!
  * Detects dead-locks and reports `operation_would_block_k`.
+ *
+ * @tparam tracer_at    Receives lock acquisition and holding events.
+ *                      Inherited from the underlying collection by default.
+ * @tparam latencies_at Collects per-operation latency histograms, including the
+ *                      time spent waiting for locks. Disabled by default.
+ *                      @see `latency_histograms_gt`.
  */
-template <typename collection_at, typename shared_mutex_at = std::shared_mutex>
+template <typename collection_at,
+          typename shared_mutex_at = std::shared_mutex,
+          typename tracer_at = typename collection_at::tracer_t,
+          typename latencies_at = no_latencies_t>
 class locked_gt {
 
   public:
@@ -16,6 +29,11 @@ class locked_gt {
     using unlocked_t = collection_at;
     using unlocked_transaction_t = typename unlocked_t::transaction_t;
     using shared_mutex_t = shared_mutex_at;
+    using tracer_t = tracer_at;
+    using shared_lock_t = traced_lock_gt<std::shared_lock<shared_mutex_t>, tracer_t>;
+    using unique_lock_t = traced_lock_gt<std::unique_lock<shared_mutex_t>, tracer_t>;
+    using latencies_t = latencies_at;
+    using latency_scope_t = latency_scope_gt<latencies_t>;
 
     using element_t = typename unlocked_t::element_t;
     using comparator_t = typename unlocked_t::comparator_t;
@@ -36,7 +54,7 @@ class locked_gt {
         generation_t generation() const noexcept { return unlocked_.generation(); }
 
         [[nodiscard]] status_t watch(identifier_t const& id) noexcept {
-            std::shared_lock _ {store_.mutex_};
+            shared_lock_t _ {store_.mutex_};
             return unlocked_.watch(id);
         }
 
@@ -44,23 +62,40 @@ class locked_gt {
         [[nodiscard]] status_t upsert(element_t&& element) noexcept { return unlocked_.upsert(std::move(element)); }
         [[nodiscard]] status_t erase(identifier_t const& id) noexcept { return unlocked_.erase(id); }
 
+        /**
+         * @brief Read-only transactions only validate their watches,
+         * so they are staged under a shared lock.
+         */
         [[nodiscard]] status_t stage() noexcept {
-            std::unique_lock _ {store_.mutex_};
+            latency_scope_t latency {store_.latencies_, latency_operation_t::stage_k};
+            if (unlocked_.read_only()) {
+                shared_lock_t _ {store_.mutex_};
+                return unlocked_.stage();
+            }
+            unique_lock_t _ {store_.mutex_};
             return unlocked_.stage();
         }
 
         [[nodiscard]] status_t reset() noexcept {
-            std::unique_lock _ {store_.mutex_};
+            if (!unlocked_.has_staged_entries())
+                return unlocked_.reset();
+            unique_lock_t _ {store_.mutex_};
             return unlocked_.reset();
         }
+        void shrink_to_fit() noexcept { unlocked_.shrink_to_fit(); }
 
         [[nodiscard]] status_t rollback() noexcept {
-            std::unique_lock _ {store_.mutex_};
+            if (!unlocked_.has_staged_entries())
+                return unlocked_.rollback();
+            unique_lock_t _ {store_.mutex_};
             return unlocked_.rollback();
         }
 
         [[nodiscard]] status_t commit() noexcept {
-            std::unique_lock _ {store_.mutex_};
+            latency_scope_t latency {store_.latencies_, latency_operation_t::commit_k};
+            if (!unlocked_.has_staged_entries())
+                return unlocked_.commit();
+            unique_lock_t _ {store_.mutex_};
             return unlocked_.commit();
         }
 
@@ -70,19 +105,44 @@ class locked_gt {
         [[nodiscard]] status_t find(comparable_at&& comparable,
                                     callback_found_at&& callback_found,
                                     callback_missing_at&& callback_missing = {}) const noexcept {
-            std::shared_lock _ {store_.mutex_};
+            shared_lock_t _ {store_.mutex_};
             return unlocked_.find(std::forward<comparable_at>(comparable),
                                   std::forward<callback_found_at>(callback_found),
                                   std::forward<callback_missing_at>(callback_missing));
         }
 
+        template <typename callback_found_at = no_op_t, typename callback_missing_at = no_op_t>
+        [[nodiscard]] status_t find_and_watch(identifier_t const& id,
+                                              callback_found_at&& callback_found,
+                                              callback_missing_at&& callback_missing = {}) noexcept {
+            shared_lock_t _ {store_.mutex_};
+            return unlocked_.find_and_watch(id,
+                                            std::forward<callback_found_at>(callback_found),
+                                            std::forward<callback_missing_at>(callback_missing));
+        }
+
+        /**
+         * @brief Looks up and watches all the keys under a single shared lock.
+         */
+        template <typename keys_begin_at, typename keys_end_at, typename callback_found_at, typename callback_missing_at>
+        [[nodiscard]] status_t find_and_watch(keys_begin_at begin,
+                                              keys_end_at end,
+                                              callback_found_at&& callback_found,
+                                              callback_missing_at&& callback_missing) noexcept {
+            shared_lock_t _ {store_.mutex_};
+            return unlocked_.find_and_watch(begin,
+                                            end,
+                                            std::forward<callback_found_at>(callback_found),
+                                            std::forward<callback_missing_at>(callback_missing));
+        }
+
         template <typename comparable_at = identifier_t,
                   typename callback_found_at = no_op_t,
                   typename callback_missing_at = no_op_t>
         [[nodiscard]] status_t upper_bound(comparable_at&& comparable,
                                            callback_found_at&& callback_found,
                                            callback_missing_at&& callback_missing = {}) const noexcept {
-            std::shared_lock _ {store_.mutex_};
+            shared_lock_t _ {store_.mutex_};
             return unlocked_.upper_bound(std::forward<comparable_at>(comparable),
                                          std::forward<callback_found_at>(callback_found),
                                          std::forward<callback_missing_at>(callback_missing));
@@ -92,50 +152,91 @@ class locked_gt {
   private:
     mutable shared_mutex_t mutex_;
     unlocked_t unlocked_;
+    mutable latencies_t latencies_;
 
     locked_gt(unlocked_t&& unlocked) noexcept : unlocked_(std::move(unlocked)) {}
     locked_gt& operator=(locked_gt&& other) noexcept {
-        std::unique_lock _ {mutex_};
+        unique_lock_t _ {mutex_};
         unlocked_ = std::move(other.unlocked_);
+        latencies_ = std::move(other.latencies_);
         return *this;
     }
 
+    /**
+     * @brief Wraps the @p callback to count the visited elements,
+     * but only if the latencies are being collected.
+     */
+    template <typename callback_at>
+    decltype(auto) counting(callback_at& callback, std::size_t& count) const noexcept {
+        if constexpr (latencies_t::enabled_k)
+            return [&](auto&& element) noexcept(noexcept(callback(element))) { ++count, callback(element); };
+        else
+            return (callback);
+    }
+
   public:
-    locked_gt(locked_gt&& other) noexcept : unlocked_(std::move(other.unlocked_)) {}
+    locked_gt(locked_gt&& other) noexcept
+        : unlocked_(std::move(other.unlocked_)), latencies_(std::move(other.latencies_)) {}
+
+    /**
+     * @brief Merges the latency histogram of a certain operation across all threads.
+     * The values are measured in `cpu_ticks()`.
+     */
+    [[nodiscard]] latency_histogram_t latencies(latency_operation_t operation) const noexcept {
+        return latencies_.merged(operation);
+    }
 
     [[nodiscard]] std::size_t size() const noexcept {
-        std::shared_lock _ {mutex_};
+        shared_lock_t _ {mutex_};
         return unlocked_.size();
     }
 
     [[nodiscard]] bool empty() const noexcept {
-        std::shared_lock _ {mutex_};
+        shared_lock_t _ {mutex_};
         return unlocked_.empty();
     }
 
-    [[nodiscard]] static std::optional<locked_gt> make() noexcept {
+    [[nodiscard]] std::size_t memory_usage() const noexcept { return unlocked_.memory_usage(); }
+    [[nodiscard]] std::size_t memory_limit() const noexcept { return unlocked_.memory_limit(); }
+    void limit_memory(std::size_t bytes) noexcept { unlocked_.limit_memory(bytes); }
+
+    /**
+     * @brief The comparator never changes after construction, so reading it needs no lock.
+     */
+    [[nodiscard]] comparator_t const& comparator() const noexcept { return unlocked_.comparator(); }
+
+    [[nodiscard]] static std::optional<locked_gt> make(typename unlocked_t::allocator_t&& allocator = {},
+                                                       comparator_t const& comparator = {}) noexcept {
         std::optional<locked_gt> result;
-        if (std::optional<unlocked_t> unlocked = unlocked_t::make(); unlocked)
+        if (std::optional<unlocked_t> unlocked = unlocked_t::make(std::move(allocator), comparator); unlocked)
             result.emplace(locked_gt {std::move(unlocked).value()});
         return result;
     }
 
+    /**
+     * @brief Generations are drawn from `hybrid_clock_t` above the atomic `generation_floor_t`
+     * of the container, and the rest of the transaction state is private,
+     * so starting one never blocks writers.
+     */
     [[nodiscard]] std::optional<transaction_t> transaction() noexcept {
         std::optional<transaction_t> result;
-        std::unique_lock _ {mutex_};
         if (auto unlocked = unlocked_.transaction(); unlocked)
             result.emplace(transaction_t {*this, std::move(unlocked).value()});
         return result;
     }
 
     [[nodiscard]] status_t upsert(element_t&& element) noexcept {
-        std::unique_lock _ {mutex_};
+        latency_scope_t latency {latencies_, latency_operation_t::upsert_k};
+        unique_lock_t _ {mutex_};
         return unlocked_.upsert(std::forward<element_t>(element));
     }
 
     template <typename elements_begin_at, typename elements_end_at = elements_begin_at>
     [[nodiscard]] status_t upsert(elements_begin_at begin, elements_end_at end) noexcept {
-        std::unique_lock _ {mutex_};
+        latency_scope_t latency {latencies_, latency_operation_t::upsert_batch_per_element_k};
+        if constexpr (latencies_t::enabled_k)
+            latency.elements(std::distance(begin, end));
+        unique_lock_t _ {mutex_};
         return unlocked_.upsert(begin, end);
     }
 
@@ -145,7 +246,8 @@ class locked_gt {
     [[nodiscard]] status_t find(comparable_at&& comparable,
                                 callback_found_at&& callback_found,
                                 callback_missing_at&& callback_missing = {}) const noexcept {
-        std::shared_lock _ {mutex_};
+        latency_scope_t latency {latencies_, latency_operation_t::find_k};
+        shared_lock_t _ {mutex_};
         return unlocked_.find(std::forward<comparable_at>(comparable),
                               std::forward<callback_found_at>(callback_found),
                               std::forward<callback_missing_at>(callback_missing));
@@ -157,7 +259,8 @@ class locked_gt {
     [[nodiscard]] status_t upper_bound(comparable_at&& comparable,
                                        callback_found_at&& callback_found,
                                        callback_missing_at&& callback_missing = {}) const noexcept {
-        std::shared_lock _ {mutex_};
+        latency_scope_t latency {latencies_, latency_operation_t::upper_bound_k};
+        shared_lock_t _ {mutex_};
         return unlocked_.upper_bound(std::forward<comparable_at>(comparable),
                                      std::forward<callback_found_at>(callback_found),
                                      std::forward<callback_missing_at>(callback_missing));
@@ -165,35 +268,58 @@ class locked_gt {
 
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) const noexcept {
-        std::shared_lock _ {mutex_};
-        return unlocked_.range(std::forward<lower_at>(lower),
-                               std::forward<upper_at>(upper),
-                               std::forward<callback_at>(callback));
+        latency_scope_t latency {latencies_, latency_operation_t::range_per_element_k};
+        std::size_t count = 0;
+        shared_lock_t _ {mutex_};
+        auto status = unlocked_.range(std::forward<lower_at>(lower),
+                                      std::forward<upper_at>(upper),
+                                      counting(callback, count));
+        latency.elements(count);
+        return status;
     }
 
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) noexcept {
-        std::unique_lock _ {mutex_};
-        return unlocked_.range(std::forward<lower_at>(lower),
-                               std::forward<upper_at>(upper),
-                               std::forward<callback_at>(callback));
+        latency_scope_t latency {latencies_, latency_operation_t::range_per_element_k};
+        std::size_t count = 0;
+        unique_lock_t _ {mutex_};
+        auto status = unlocked_.range(std::forward<lower_at>(lower),
+                                      std::forward<upper_at>(upper),
+                                      counting(callback, count));
+        latency.elements(count);
+        return status;
     }
 
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t erase_range(lower_at&& lower, upper_at&& upper, callback_at&& callback) noexcept {
-        std::unique_lock _ {mutex_};
+        unique_lock_t _ {mutex_};
         return unlocked_.erase_range(std::forward<lower_at>(lower),
                                      std::forward<upper_at>(upper),
                                      std::forward<callback_at>(callback));
     }
 
     [[nodiscard]] status_t clear() noexcept {
-        std::unique_lock _ {mutex_};
+        unique_lock_t _ {mutex_};
         return unlocked_.clear();
     }
 
+    std::size_t shrink_to_fit() noexcept {
+        unique_lock_t _ {mutex_};
+        return unlocked_.shrink_to_fit();
+    }
+
+    [[nodiscard]] status_t defragment(std::size_t budget) noexcept {
+        unique_lock_t _ {mutex_};
+        return unlocked_.defragment(budget);
+    }
+
+    [[nodiscard]] std::size_t neighbor_distance() const noexcept {
+        shared_lock_t _ {mutex_};
+        return unlocked_.neighbor_distance();
+    }
+
     [[nodiscard]] status_t reserve(std::size_t size) noexcept {
-        std::unique_lock _ {mutex_};
+        unique_lock_t _ {mutex_};
         return unlocked_.reserve(size);
     }
 
@@ -202,7 +328,7 @@ class locked_gt {
                                         upper_at&& upper,
                                         generator_at&& generator,
                                         callback_at&& callback) const noexcept {
-        std::shared_lock _ {mutex_};
+        shared_lock_t _ {mutex_};
         return unlocked_.sample_range(std::forward<lower_at>(lower),
                                       std::forward<upper_at>(upper),
                                       std::forward<generator_at>(generator),
@@ -216,7 +342,7 @@ class locked_gt {
                                         std::size_t& seen,
                                         std::size_t reservoir_capacity,
                                         output_iterator_at&& reservoir) const noexcept {
-        std::shared_lock _ {mutex_};
+        shared_lock_t _ {mutex_};
         return unlocked_.sample_range(std::forward<lower_at>(lower),
                                       std::forward<upper_at>(upper),
                                       std::forward<generator_at>(generator),
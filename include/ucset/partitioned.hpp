@@ -1,10 +1,15 @@
 #pragma once
+#include <algorithm>    // `std::any_of`, `std::all_of`, `std::max`
 #include <array>        // `std::array`
 #include <optional>     // `std::optional`
 #include <functional>   // `std::hash`
+#include <memory>       // `std::unique_ptr`
 #include <shared_mutex> // `std::shared_mutex`
 #include <atomic>
 
+#include "latencies.hpp"
+#include "tracing.hpp"
+
 namespace unum::ucset {
 
 template <typename at, std::size_t count_ak, std::size_t... sequence_ak>
@@ -53,12 +58,19 @@ static std::optional<std::array<at, count_ak>> generate_array_safely(generator_a
  * be concurrent, or have a separate state-full allocator attached.
  *
  * @tparam hash_at Keys that compare equal must have the same hashes.
+ *                 Stored once per collection, so it can be salted or seeded.
+ * @tparam tracer_at Receives lock events, with the partition index as the argument.
+ *                   Inherited from the underlying collection by default.
+ * @tparam latencies_at Collects per-operation latency histograms. Disabled by default.
+ *                      @see `latency_histograms_gt`.
  */
 template <typename collection_at,
           typename hash_at = std::hash<typename collection_at::identifier_t>,
           typename shared_mutex_at = std::shared_mutex,
-          std::size_t parts_ak = 16>
-class partitioned_gt {
+          std::size_t parts_ak = 16,
+          typename tracer_at = typename collection_at::tracer_t,
+          typename latencies_at = no_latencies_t>
+class partitioned_gt : private functor_holder_gt<hash_at> {
 
   public:
     static constexpr std::size_t parts_k = parts_ak;
@@ -67,8 +79,11 @@ class partitioned_gt {
     using part_t = collection_at;
     using part_transaction_t = typename part_t::transaction_t;
     using shared_mutex_t = shared_mutex_at;
-    using shared_lock_t = std::shared_lock<shared_mutex_t>;
-    using unique_lock_t = std::unique_lock<shared_mutex_t>;
+    using tracer_t = tracer_at;
+    using shared_lock_t = traced_lock_gt<std::shared_lock<shared_mutex_t>, tracer_t>;
+    using unique_lock_t = traced_lock_gt<std::unique_lock<shared_mutex_t>, tracer_t>;
+    using latencies_t = latencies_at;
+    using latency_scope_t = latency_scope_gt<latencies_t>;
 
     using mutexes_t = std::array<shared_mutex_t, parts_k>;
     using parts_t = std::array<part_t, parts_k>;
@@ -76,11 +91,14 @@ class partitioned_gt {
 
     using element_t = typename part_t::element_t;
     using comparator_t = typename part_t::comparator_t;
+    using allocator_t = typename part_t::allocator_t;
     using identifier_t = typename part_t::identifier_t;
     using generation_t = typename part_t::generation_t;
 
   private:
-    static std::size_t bucket(identifier_t const& id) noexcept { return hash_t {}(id) % parts_k; }
+    using hash_holder_t = functor_holder_gt<hash_t>;
+
+    std::size_t bucket(identifier_t const& id) const noexcept { return this->functor()(id) % parts_k; }
 
     template <typename lock_at, typename mutexes_at>
     static void lock_out_of_order(mutexes_at& mutexes) noexcept {
@@ -91,6 +109,7 @@ class partitioned_gt {
         constexpr bool make_shared = std::is_same<lock_at, shared_lock_t>();
         constexpr bool make_unique = std::is_same<lock_at, unique_lock_t>();
         static_assert(make_shared || make_unique);
+        trace_scope_gt<tracer_t> _ {trace_event_t::acquire_k, parts_k};
 
     cycle:
         // We may need to cycle multiple times, attempting to acquire locks,
@@ -126,7 +145,7 @@ class partitioned_gt {
         for (std::size_t part_idx = 0; part_idx != parts_k; ++part_idx) {
             if (finished[part_idx])
                 continue;
-            lock_at lock {mutexes[part_idx], std::try_to_lock_t {}};
+            lock_at lock {mutexes[part_idx], std::try_to_lock_t {}, part_idx};
             if (!lock)
                 continue;
 
@@ -154,7 +173,8 @@ class partitioned_gt {
                                          mutexes_at& mutexes,
                                          comparable_at&& comparable,
                                          callback_found_at&& callback_found,
-                                         callback_missing_at&& callback_missing) noexcept {
+                                         callback_missing_at&& callback_missing,
+                                         comparator_t const& less) noexcept {
 
         status_t status;
         std::array<bool, parts_k> finished;
@@ -172,13 +192,13 @@ class partitioned_gt {
         for (std::size_t part_idx = 0; part_idx != parts_k; ++part_idx) {
             if (finished[part_idx])
                 continue;
-            shared_lock_t lock {mutexes[part_idx], std::try_to_lock_t {}};
+            shared_lock_t lock {mutexes[part_idx], std::try_to_lock_t {}, part_idx};
             if (!lock)
                 continue;
 
             auto& part = parts[part_idx];
             status = part.upper_bound(comparable, [&](element_t const& element) {
-                if (smallest_idx != not_found_idx && !comparator_t {}(element, smallest_id))
+                if (smallest_idx != not_found_idx && !less(element, smallest_id))
                     return;
                 smallest_id = identifier_t(element);
                 smallest_idx = part_idx;
@@ -220,32 +240,68 @@ class partitioned_gt {
             return partitioned_t::for_all<unique_lock_t>(parts_, store_.mutexes_, std::forward<callable_at>(callable));
         }
 
+        /// Draws above the generations of all the part transactions, and so above every part.
+        generation_t next_generation() const noexcept {
+            generation_t floor = 0;
+            for (auto const& part : parts_)
+                floor = std::max(floor, part.generation());
+            return hybrid_clock_t::next(floor);
+        }
+
+        /**
+         * @brief Locks the parts only if some of them have staged entries in the container,
+         * otherwise the @p callable only touches the state of the part transactions.
+         */
+        template <typename callable_at>
+        status_t for_parts_if_staged(callable_at&& callable) noexcept {
+            if (std::any_of(parts_.begin(), parts_.end(), std::mem_fn(&part_transaction_t::has_staged_entries)))
+                return for_parts(std::forward<callable_at>(callable));
+            status_t status;
+            for (auto& part : parts_)
+                if (status = callable(part); !status)
+                    break;
+            return status;
+        }
+
       public:
         transaction_t(partitioned_gt& db, part_transactions_t&& unlocked) noexcept
-            : store_(db), parts_(std::move(unlocked)), generation_(db.new_generation()) {}
+            : store_(db), parts_(std::move(unlocked)), generation_(next_generation()) {}
         transaction_t(transaction_t&&) noexcept = default;
         transaction_t& operator=(transaction_t&&) noexcept = default;
         generation_t generation() const noexcept { return generation_; }
 
         [[nodiscard]] status_t reset() noexcept {
-            auto status = for_parts(std::mem_fn(&part_transaction_t::reset));
+            auto status = for_parts_if_staged(std::mem_fn(&part_transaction_t::reset));
             if (status)
-                generation_ = store_.new_generation();
+                generation_ = next_generation();
             return status;
         }
+        void shrink_to_fit() noexcept {
+            for (auto& part : parts_)
+                part.shrink_to_fit();
+        }
         [[nodiscard]] status_t rollback() noexcept {
-            auto status = for_parts(std::mem_fn(&part_transaction_t::rollback));
+            auto status = for_parts_if_staged(std::mem_fn(&part_transaction_t::rollback));
             if (status)
-                generation_ = store_.new_generation();
+                generation_ = next_generation();
             return status;
         }
 
-        [[nodiscard]] status_t stage() noexcept { return for_parts(std::mem_fn(&part_transaction_t::stage)); }
-        [[nodiscard]] status_t commit() noexcept { return for_parts(std::mem_fn(&part_transaction_t::commit)); }
+        [[nodiscard]] status_t stage() noexcept {
+            latency_scope_t latency {store_.latencies_, latency_operation_t::stage_k};
+            if (std::all_of(parts_.begin(), parts_.end(), std::mem_fn(&part_transaction_t::read_only)))
+                return partitioned_t::for_all<shared_lock_t>(
+                    parts_, store_.mutexes_, std::mem_fn(&part_transaction_t::stage));
+            return for_parts(std::mem_fn(&part_transaction_t::stage));
+        }
+        [[nodiscard]] status_t commit() noexcept {
+            latency_scope_t latency {store_.latencies_, latency_operation_t::commit_k};
+            return for_parts_if_staged(std::mem_fn(&part_transaction_t::commit));
+        }
 
         [[nodiscard]] status_t watch(identifier_t const& id) noexcept {
-            std::size_t part_idx = bucket(id);
-            shared_lock_t _ {store_.mutexes_[part_idx]};
+            std::size_t part_idx = store_.bucket(id);
+            shared_lock_t _ {store_.mutexes_[part_idx], part_idx};
             return parts_[part_idx].watch(id);
         }
 
@@ -255,13 +311,40 @@ class partitioned_gt {
         [[nodiscard]] status_t find(comparable_at&& comparable,
                                     callback_found_at&& callback_found,
                                     callback_missing_at&& callback_missing = {}) const noexcept {
-            std::size_t part_idx = bucket(identifier_t(comparable));
-            shared_lock_t _ {store_.mutexes_[part_idx]};
+            std::size_t part_idx = store_.bucket(identifier_t(comparable));
+            shared_lock_t _ {store_.mutexes_[part_idx], part_idx};
             return parts_[part_idx].find(std::forward<comparable_at>(comparable),
                                          std::forward<callback_found_at>(callback_found),
                                          std::forward<callback_missing_at>(callback_missing));
         }
 
+        template <typename callback_found_at = no_op_t, typename callback_missing_at = no_op_t>
+        [[nodiscard]] status_t find_and_watch(identifier_t const& id,
+                                              callback_found_at&& callback_found,
+                                              callback_missing_at&& callback_missing = {}) noexcept {
+            std::size_t part_idx = store_.bucket(id);
+            shared_lock_t _ {store_.mutexes_[part_idx], part_idx};
+            return parts_[part_idx].find_and_watch(id,
+                                                   std::forward<callback_found_at>(callback_found),
+                                                   std::forward<callback_missing_at>(callback_missing));
+        }
+
+        /**
+         * @brief Looks up and watches the keys one by one, locking only the part of each.
+         */
+        template <typename keys_begin_at, typename keys_end_at, typename callback_found_at, typename callback_missing_at>
+        [[nodiscard]] status_t find_and_watch(keys_begin_at begin,
+                                              keys_end_at end,
+                                              callback_found_at&& callback_found,
+                                              callback_missing_at&& callback_missing) noexcept {
+            for (; begin != end; ++begin) {
+                identifier_t const& id = *begin;
+                if (auto status = find_and_watch(id, callback_found, [&] { callback_missing(id); }); !status)
+                    return status;
+            }
+            return {success_k};
+        }
+
         template <typename comparable_at = identifier_t,
                   typename callback_found_at = no_op_t,
                   typename callback_missing_at = no_op_t>
@@ -272,57 +355,122 @@ class partitioned_gt {
                                                        store_.mutexes_,
                                                        std::forward<comparable_at>(comparable),
                                                        std::forward<callback_found_at>(callback_found),
-                                                       std::forward<callback_missing_at>(callback_missing));
+                                                       std::forward<callback_missing_at>(callback_missing),
+                                                       store_.comparator());
         }
 
         [[nodiscard]] status_t upsert(element_t&& element) noexcept {
-            return parts_[bucket(identifier_t(element))].upsert(std::move(element));
+            return parts_[store_.bucket(identifier_t(element))].upsert(std::move(element));
         }
 
         [[nodiscard]] status_t erase(identifier_t const& id) noexcept { //
-            return parts_[bucket(id)].erase(id);
+            return parts_[store_.bucket(id)].erase(id);
         }
     };
 
   private:
     mutable mutexes_t mutexes_;
+    /// Shared by all the parts, and must outlive them, as they release memory into it.
+    std::unique_ptr<memory_budget_t> budget_;
     parts_t parts_;
-    std::atomic<generation_t> generation_;
+    mutable latencies_t latencies_;
 
     friend class transaction_t;
 
-    partitioned_gt(parts_t&& unlocked) noexcept : parts_(std::move(unlocked)) {}
+    partitioned_gt(parts_t&& unlocked, hash_t const& hash) noexcept
+        : hash_holder_t(hash), budget_(new (std::nothrow) memory_budget_t), parts_(std::move(unlocked)) {
+        if (budget_)
+            for (auto& part : parts_)
+                part.share_memory(*budget_);
+    }
     partitioned_gt& operator=(partitioned_gt&& other) noexcept {
         lock_out_of_order<unique_lock_t>(mutexes_);
+        static_cast<hash_holder_t&>(*this) = static_cast<hash_holder_t const&>(other);
+        std::swap(budget_, other.budget_);
         parts_ = std::move(other.parts_);
+        latencies_ = std::move(other.latencies_);
         for (auto& mutex : mutexes_)
             mutex.unlock();
         return *this;
     }
 
-    static std::optional<parts_t> new_parts() noexcept {
-        return generate_array_safely<part_t, parts_k>([](std::size_t) { return part_t::make(); });
+    /**
+     * @brief Wraps the @p callback to count the visited elements,
+     * but only if the latencies are being collected.
+     */
+    template <typename callback_at>
+    decltype(auto) counting(callback_at& callback, std::size_t& count) const noexcept {
+        if constexpr (latencies_t::enabled_k)
+            return [&](auto&& element) noexcept(noexcept(callback(element))) { ++count, callback(element); };
+        else
+            return (callback);
     }
 
-    generation_t new_generation() noexcept { return ++generation_; }
+    template <typename allocator_for_part_at>
+    static std::optional<parts_t> new_parts(allocator_for_part_at&& allocator_for_part,
+                                            comparator_t const& comparator) noexcept {
+        return generate_array_safely<part_t, parts_k>(
+            [&](std::size_t part_idx) { return part_t::make(allocator_for_part(part_idx), comparator); });
+    }
 
   public:
-    partitioned_gt(partitioned_gt&& other) noexcept : parts_(std::move(other.parts_)) {}
+    partitioned_gt(partitioned_gt&& other) noexcept
+        : hash_holder_t(other.hash()), budget_(std::move(other.budget_)), parts_(std::move(other.parts_)),
+          latencies_(std::move(other.latencies_)) {}
+
+    /**
+     * @brief Merges the latency histogram of a certain operation across all threads.
+     * The values are measured in `cpu_ticks()`.
+     */
+    [[nodiscard]] latency_histogram_t latencies(latency_operation_t operation) const noexcept {
+        return latencies_.merged(operation);
+    }
+
+    [[nodiscard]] hash_t const& hash() const noexcept { return this->functor(); }
+
+    /**
+     * @brief All the parts share the same comparator, so the first one speaks for all.
+     */
+    [[nodiscard]] comparator_t const& comparator() const noexcept { return parts_[0].comparator(); }
 
     [[nodiscard]] std::size_t size() const noexcept {
         std::size_t total = 0;
         lock_out_of_order<shared_lock_t>(mutexes_);
         for (auto const& part : parts_)
-            total += parts_.size();
+            total += part.size();
         for (auto& mutex : mutexes_)
             mutex.unlock_shared();
         return total;
     }
 
+    [[nodiscard]] std::size_t memory_usage() const noexcept { return budget_->usage(); }
+    [[nodiscard]] std::size_t memory_limit() const noexcept { return budget_->limit(); }
+
+    /**
+     * @brief Limits all the parts together, as every part charges its allocations
+     * to the shared budget, so skewed keys can use all of it.
+     */
+    void limit_memory(std::size_t bytes) noexcept { budget_->limit(bytes); }
+
     [[nodiscard]] static std::optional<partitioned_gt> make() noexcept {
+        return make([](std::size_t) noexcept { return allocator_t {}; });
+    }
+
+    /**
+     * @brief Creates a collection with a separate allocator for every part,
+     * for example an @c `arena_t` bound to the NUMA node, that serves that part.
+     * @param allocator_for_part    Callback, that receives a part index and returns an `allocator_t`.
+     * @param hash                  Routes keys to parts, copied once into the collection.
+     * @param comparator            Copied into every part.
+     */
+    template <typename allocator_for_part_at>
+    [[nodiscard]] static std::optional<partitioned_gt> make(allocator_for_part_at&& allocator_for_part,
+                                                            hash_t const& hash = {},
+                                                            comparator_t const& comparator = {}) noexcept {
         std::optional<partitioned_gt> result;
-        if (std::optional<parts_t> unlocked = new_parts(); unlocked)
-            result.emplace(partitioned_gt {std::move(unlocked).value()});
+        if (std::optional<parts_t> unlocked = new_parts(allocator_for_part, comparator); unlocked)
+            if (partitioned_gt store {std::move(unlocked).value(), hash}; store.budget_)
+                result.emplace(std::move(store));
         return result;
     }
 
@@ -336,8 +484,9 @@ class partitioned_gt {
     }
 
     [[nodiscard]] status_t upsert(element_t&& element) noexcept {
+        latency_scope_t latency {latencies_, latency_operation_t::upsert_k};
         std::size_t part_idx = bucket(identifier_t(element));
-        unique_lock_t _ {mutexes_[part_idx]};
+        unique_lock_t _ {mutexes_[part_idx], part_idx};
         return parts_[part_idx].upsert(std::move(element));
     }
 
@@ -345,12 +494,16 @@ class partitioned_gt {
     [[nodiscard]] status_t upsert(elements_begin_at begin, elements_end_at end) noexcept {
         // This might be implemented more efficiently, but using
         // a transaction beneath looks like the most straightforward approach.
+        latency_scope_t latency {latencies_, latency_operation_t::upsert_batch_per_element_k};
+        // Parts only fail to start transactions, once out of budget or out of heap.
         auto maybe = transaction();
         if (!maybe)
-            return {consistency_k};
-        for (; begin != end; ++begin)
-            if (auto status = maybe->upsert(*begin); !status)
+            return {budget_->exhausted() ? out_of_memory_arena_k : out_of_memory_heap_k};
+        std::size_t count = 0;
+        for (; begin != end; ++begin, ++count)
+            if (auto status = maybe->upsert(element_from<element_t>(*begin)); !status)
                 return status;
+        latency.elements(count);
         if (auto status = maybe->stage(); !status)
             return status;
         return maybe->commit();
@@ -362,8 +515,9 @@ class partitioned_gt {
     [[nodiscard]] status_t find(comparable_at&& comparable,
                                 callback_found_at&& callback_found,
                                 callback_missing_at&& callback_missing = {}) const noexcept {
+        latency_scope_t latency {latencies_, latency_operation_t::find_k};
         std::size_t part_idx = bucket(identifier_t(comparable));
-        shared_lock_t _ {mutexes_[part_idx]};
+        shared_lock_t _ {mutexes_[part_idx], part_idx};
         return parts_[part_idx].find(std::forward<comparable_at>(comparable),
                                      std::forward<callback_found_at>(callback_found),
                                      std::forward<callback_missing_at>(callback_missing));
@@ -375,34 +529,44 @@ class partitioned_gt {
     [[nodiscard]] status_t upper_bound(comparable_at&& comparable,
                                        callback_found_at&& callback_found,
                                        callback_missing_at&& callback_missing = {}) const noexcept {
+        latency_scope_t latency {latencies_, latency_operation_t::upper_bound_k};
         return for_all_next_lookups(parts_,
                                     mutexes_,
                                     std::forward<comparable_at>(comparable),
                                     std::forward<callback_found_at>(callback_found),
-                                    std::forward<callback_missing_at>(callback_missing));
+                                    std::forward<callback_missing_at>(callback_missing),
+                                    comparator());
     }
 
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) const noexcept {
+        latency_scope_t latency {latencies_, latency_operation_t::range_per_element_k};
+        std::size_t count = 0;
+        decltype(auto) counted = counting(callback, count);
         lock_out_of_order<shared_lock_t>(mutexes_);
         status_t status;
         for (auto& part : parts_)
-            if (status = part.range(lower, upper, callback); !status)
+            if (status = part.range(lower, upper, counted); !status)
                 break;
         for (auto& mutex : mutexes_)
             mutex.unlock_shared();
+        latency.elements(count);
         return status;
     }
 
     template <typename lower_at = identifier_t, typename upper_at = identifier_t, typename callback_at = no_op_t>
     [[nodiscard]] status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) noexcept {
+        latency_scope_t latency {latencies_, latency_operation_t::range_per_element_k};
+        std::size_t count = 0;
+        decltype(auto) counted = counting(callback, count);
         lock_out_of_order<unique_lock_t>(mutexes_);
         status_t status;
         for (auto& part : parts_)
-            if (status = part.range(lower, upper, callback); !status)
+            if (status = part.range(lower, upper, counted); !status)
                 break;
         for (auto& mutex : mutexes_)
             mutex.unlock_shared();
+        latency.elements(count);
         return status;
     }
 
@@ -426,7 +590,7 @@ class partitioned_gt {
         // ! Here the assumption is that every part will have a somewhat equal
         // ! number of entries that compare equal to the provided range.
         std::size_t part_idx = generator() % parts_k;
-        shared_lock_t _ {mutexes_[part_idx]};
+        shared_lock_t _ {mutexes_[part_idx], part_idx};
         return parts_[part_idx].sample_range(std::forward<lower_at>(lower),
                                              std::forward<upper_at>(upper),
                                              std::forward<generator_at>(generator),
@@ -446,18 +610,56 @@ class partitioned_gt {
         });
     }
 
+    /**
+     * @brief Clears the parts in-place, preserving their allocators and budgets.
+     */
     [[nodiscard]] status_t clear() noexcept {
+        status_t status;
+        lock_out_of_order<unique_lock_t>(mutexes_);
+        for (auto& part : parts_)
+            if (status = part.clear(); !status)
+                break;
+        for (auto& mutex : mutexes_)
+            mutex.unlock();
+        return status;
+    }
 
-        auto maybe = new_parts();
-        if (!maybe)
-            return {unknown_k};
-
+    std::size_t shrink_to_fit() noexcept {
+        std::size_t released = 0;
         lock_out_of_order<unique_lock_t>(mutexes_);
-        parts_ = std::move(maybe).value();
+        for (auto& part : parts_)
+            released += part.shrink_to_fit();
         for (auto& mutex : mutexes_)
             mutex.unlock();
+        return released;
+    }
+
+    /**
+     * @brief Defragments every part by up to @p budget nodes, locking one part at a time,
+     * so that other parts stay available, and pauses stay bounded.
+     */
+    [[nodiscard]] status_t defragment(std::size_t budget) noexcept {
+        for (std::size_t part_idx = 0; part_idx != parts_k; ++part_idx) {
+            unique_lock_t _ {mutexes_[part_idx], part_idx};
+            if (auto status = parts_[part_idx].defragment(budget); !status)
+                return status;
+        }
         return {success_k};
     }
+
+    /**
+     * @brief Average distance in bytes between in-order neighbors within every part, weighted by their sizes.
+     */
+    [[nodiscard]] std::size_t neighbor_distance() const noexcept {
+        std::size_t total = 0, count = 0;
+        for (std::size_t part_idx = 0; part_idx != parts_k; ++part_idx) {
+            shared_lock_t _ {mutexes_[part_idx], part_idx};
+            std::size_t size = parts_[part_idx].size();
+            total += parts_[part_idx].neighbor_distance() * size;
+            count += size;
+        }
+        return count ? total / count : 0;
+    }
 };
 
 } // namespace unum::ucset
\ No newline at end of file
@@ -1,6 +1,13 @@
 #pragma once
+#include <algorithm>    // `std::max`
+#include <atomic>       // `std::atomic`
+#include <chrono>       // `std::chrono::steady_clock`
 #include <cstdint>      //
+#include <cstring>      // `std::memcpy`
+#include <new>          // `std::bad_alloc`
 #include <system_error> // `ENOMEM`
+#include <type_traits>  // `std::is_same`
+#include <utility>      // `std::forward`
 
 namespace unum::ucset {
 
@@ -40,12 +47,56 @@ struct status_t {
     constexpr operator bool() const noexcept { return errc == errc_t::success_k; }
 };
 
+/**
+ * @brief Thrown by budgeted allocators, when a container exceeds its own memory limit,
+ * rather than the process running out of heap. Reported as `out_of_memory_arena_k`.
+ */
+struct out_of_budget_t : public std::bad_alloc {
+    char const* what() const noexcept override { return "ucset: memory budget exceeded"; }
+};
+
+template <typename callable_at>
+status_t invoke_safely(callable_at&& callable) noexcept {
+    if constexpr (noexcept(callable())) {
+        callable();
+        return {success_k};
+    }
+    else {
+        try {
+            callable();
+            return {success_k};
+        }
+        catch (out_of_budget_t const&) {
+            return {errc_t::out_of_memory_arena_k};
+        }
+        catch (std::bad_alloc const&) {
+            return {errc_t::out_of_memory_heap_k};
+        }
+        catch (...) {
+            return {errc_t::unknown_k};
+        }
+    }
+}
+
 struct no_op_t {
     constexpr void operator()() const noexcept {}
     template <typename at>
     constexpr void operator()(at&&) const noexcept {}
 };
 
+/**
+ * @brief Keeps a comparator or a hasher once per container, so that it can
+ * carry state, like a collation table or a seed. Derives from the functor,
+ * so that stateless ones still take no space.
+ */
+template <typename functor_at>
+class functor_holder_gt : private functor_at {
+  public:
+    functor_holder_gt() = default;
+    functor_holder_gt(functor_at const& functor) noexcept : functor_at(functor) {}
+    functor_at const& functor() const noexcept { return *this; }
+};
+
 template <typename element_at>
 struct copy_to_gt {
     element_at& target;
@@ -60,14 +111,258 @@ copy_to_gt<element_at> copy_to(element_at& element) noexcept {
     return {element};
 }
 
-template <typename element_at, typename comparator_at>
+/**
+ * @brief Constructs an element in the uninitialized @p target storage, moving from
+ * R-Value @p source and copying from L-Values. Trivially copyable types are copied
+ * bytewise, without calling constructors. Move-only types need R-Values.
+ */
+template <typename element_at, typename source_at>
+void construct_from(element_at& target, source_at&& source) noexcept(
+    std::is_nothrow_constructible<element_at, source_at&&>()) {
+    if constexpr (std::is_trivially_copyable<element_at>() && std::is_same<std::decay_t<source_at>, element_at>())
+        std::memcpy(static_cast<void*>(&target), &source, sizeof(element_at));
+    else
+        new (&target) element_at(std::forward<source_at>(source));
+}
+
+/**
+ * @brief Passes R-Value elements through untouched, and constructs a temporary
+ * from anything else, so batch APIs can forward `*begin` into `upsert(element_t&&)`
+ * without copying the elements yielded by `std::move_iterator`.
+ */
+template <typename element_at, typename source_at>
+decltype(auto) element_from(source_at&& source) noexcept(std::is_nothrow_constructible<element_at, source_at&&>()) {
+    if constexpr (std::is_same<source_at, element_at>())
+        return static_cast<element_at&&>(source);
+    else
+        return element_at(std::forward<source_at>(source));
+}
+
+/**
+ * @brief Default layout of versioned entries, with every field separately addressable.
+ */
+struct padded_layout_t {};
+
+/**
+ * @brief Layout, that folds the `deleted` and `visible` flags into the two highest
+ * bits of the generation, saving a word per entry for small elements.
+ * Limits generations to 62 bits, which is still centuries of nanosecond ticks.
+ */
+struct compact_layout_t {};
+
+/**
+ * @brief Layout without any versioning, for stores that never use transactions.
+ * Entries hold just the element, while the generation and the flags become
+ * compile-time constants. Only supported by @c `consistent_avl_gt`.
+ */
+struct unversioned_layout_t {};
+
+template <typename element_at, typename generation_at, typename layout_at>
+struct entry_fields_gt;
+
+template <typename element_at, typename generation_at>
+struct entry_fields_gt<element_at, generation_at, padded_layout_t> {
+    mutable element_at element;
+    mutable generation_at generation {0};
+    mutable bool deleted {false};
+    mutable bool visible {true};
+
+    entry_fields_gt() = default;
+    entry_fields_gt(element_at&& element) noexcept : element(std::move(element)) {}
+};
+
+template <typename element_at, typename generation_at>
+struct entry_fields_gt<element_at, generation_at, compact_layout_t> {
+    mutable element_at element;
+    mutable generation_at generation : 62;
+    mutable bool deleted : 1;
+    mutable bool visible : 1;
+
+    entry_fields_gt() noexcept : element(), generation(0), deleted(false), visible(true) {}
+    entry_fields_gt(element_at&& element) noexcept
+        : element(std::move(element)), generation(0), deleted(false), visible(true) {}
+};
+
+/**
+ * @brief A field, that always reads as @p value_ak and ignores all the writes,
+ * so that versioning logic compiles unchanged, but folds away.
+ */
+template <typename value_at, value_at value_ak>
+struct constant_field_gt {
+    constexpr operator value_at() const noexcept { return value_ak; }
+    constexpr constant_field_gt const& operator=(value_at) const noexcept { return *this; }
+    constexpr constant_field_gt const& operator|=(value_at) const noexcept { return *this; }
+};
+
+template <typename element_at, typename generation_at>
+struct entry_fields_gt<element_at, generation_at, unversioned_layout_t> {
+    static constexpr constant_field_gt<generation_at, 0> generation {};
+    static constexpr constant_field_gt<bool, false> deleted {};
+    static constexpr constant_field_gt<bool, true> visible {};
+    mutable element_at element;
+
+    entry_fields_gt() = default;
+    entry_fields_gt(element_at&& element) noexcept : element(std::move(element)) {}
+};
+
+/**
+ * @brief Detects the optional key-normalization policy of a comparator:
+ * a `prefix(key)` member, that maps keys to unsigned integers, such that
+ * `prefix(a) < prefix(b)` implies `a < b`. Equal prefixes fall back to the
+ * full comparison. Resolves to `void`, if the comparator has no such member.
+ */
+template <typename comparator_at, typename identifier_at, typename = void>
+struct key_prefix_gt {
+    using prefix_t = void;
+};
+
+template <typename comparator_at, typename identifier_at>
+struct key_prefix_gt<comparator_at,
+                     identifier_at,
+                     std::void_t<decltype(std::declval<comparator_at const&>().prefix(
+                         std::declval<identifier_at const&>()))>> {
+    using prefix_t =
+        decltype(std::declval<comparator_at const&>().prefix(std::declval<identifier_at const&>()));
+    static_assert(std::is_unsigned<prefix_t>(), "Prefixes must be compared with integer operations.");
+};
+
+template <typename prefix_at>
+struct entry_prefix_gt {
+    mutable prefix_at prefix {0};
+};
+
+template <>
+struct entry_prefix_gt<void> {};
+
+/**
+ * @brief Hybrid logical clock, that every container draws its generations from.
+ * A generation is a microsecond tick of the steady clock, bumped logically
+ * to stay monotonic within a thread, followed by the slot of that thread.
+ * Slots make generations unique without any shared counter, and ticks keep
+ * them roughly ordered by time across threads, parts and containers.
+ * A thread, that drew many generations in a row, runs ahead of the others,
+ * so containers pass their `generation_floor_t` to order writes exactly.
+ *
+ * Up to `slots_k - 1` threads own slots at once, and the rest share slot 0,
+ * which falls back to a compare-and-swap loop over a single atomic.
+ * Generations fit into 61 bits, as required by `compact_layout_t`.
+ */
+class hybrid_clock_t {
+  public:
+    using generation_t = std::int64_t;
+    static constexpr std::size_t slot_bits_k = 10;
+    static constexpr std::size_t slots_k = std::size_t(1) << slot_bits_k;
+
+  private:
+    struct registry_t {
+        /// Slot 0 is reserved for threads, that found no free slot.
+        std::atomic<std::uint64_t> used[slots_k / 64] {{1}};
+        /// Last ticks of released slots, so that their next owners continue from there.
+        std::atomic<generation_t> ticks[slots_k] {};
+    };
+
+    static registry_t& registry() noexcept {
+        static registry_t registry;
+        return registry;
+    }
+
+    struct thread_slot_t {
+        std::size_t slot {0};
+        generation_t ticks {0};
+
+        thread_slot_t() noexcept {
+            auto& used = registry().used;
+            for (std::size_t word = 0; word != slots_k / 64 && !slot; ++word)
+                for (std::uint64_t bits = used[word].load(); ~bits;)
+                    if (used[word].compare_exchange_weak(bits, bits | (bits + 1))) {
+                        slot = word * 64 + __builtin_ctzll(~bits);
+                        ticks = registry().ticks[slot].load();
+                        break;
+                    }
+        }
+
+        ~thread_slot_t() noexcept {
+            if (!slot)
+                return;
+            registry().ticks[slot].store(ticks);
+            registry().used[slot / 64].fetch_and(~(std::uint64_t(1) << (slot % 64)));
+        }
+    };
+
+    static generation_t now() noexcept {
+        auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(since_epoch).count();
+    }
+
+  public:
+    /**
+     * @brief Draws a unique generation, that is larger than the @p floor,
+     * like a hybrid logical clock receiving a message stamped with it.
+     */
+    static generation_t next(generation_t floor = 0) noexcept {
+        thread_local thread_slot_t thread;
+        generation_t ticks = std::max(now(), (floor >> slot_bits_k) + 1);
+        if (thread.slot)
+            ticks = thread.ticks = std::max(ticks, thread.ticks + 1);
+        else {
+            auto& shared = registry().ticks[0];
+            generation_t last = shared.load(std::memory_order_relaxed);
+            while (!shared.compare_exchange_weak(last, std::max(ticks, last + 1), std::memory_order_relaxed))
+                ;
+            ticks = std::max(ticks, last + 1);
+        }
+        return (ticks << slot_bits_k) | generation_t(thread.slot);
+    }
+};
+
+/**
+ * @brief Largest generation, that a container has written, so that later writes get
+ * larger ones, even if they come from a thread, which is behind on the `hybrid_clock_t`.
+ * Writers raise it under the container lock, while transactions only read it,
+ * and can do that without locking. Moves copy the value, as containers are moved
+ * only while nobody else is using them.
+ */
+class generation_floor_t {
+    using generation_t = hybrid_clock_t::generation_t;
+    std::atomic<generation_t> value_ {0};
+
+  public:
+    generation_floor_t() noexcept = default;
+    generation_floor_t(generation_floor_t const& other) noexcept : value_(other.current()) {}
+    generation_floor_t& operator=(generation_floor_t const& other) noexcept {
+        value_.store(other.current(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    generation_t current() const noexcept { return value_.load(std::memory_order_relaxed); }
+    /// Draws a generation for a transaction, that becomes visible only once committed.
+    generation_t next() const noexcept { return hybrid_clock_t::next(current()); }
+    /// Draws a generation for a write, that becomes visible right away.
+    generation_t next_write() noexcept { return raise(next()); }
+    /// Accounts for a committed write, that was stamped with the @p generation in advance.
+    generation_t raise(generation_t generation) noexcept {
+        if (generation > current())
+            value_.store(generation, std::memory_order_relaxed);
+        return generation;
+    }
+    void swap(generation_floor_t& other) noexcept {
+        generation_t mine = current();
+        value_.store(other.current(), std::memory_order_relaxed);
+        other.value_.store(mine, std::memory_order_relaxed);
+    }
+};
+
+template <typename element_at, typename comparator_at, typename layout_at = padded_layout_t>
 struct element_versioning_gt {
 
     using element_t = element_at;
     using comparator_t = comparator_at;
+    using layout_t = layout_at;
 
     using identifier_t = typename comparator_t::value_type;
     using generation_t = std::int64_t;
+    using prefix_t = typename key_prefix_gt<comparator_t, identifier_t>::prefix_t;
+    static constexpr bool prefixed_k = !std::is_void<prefix_t>();
 
     static_assert(!std::is_reference<element_t>(), "Only value types are supported.");
     static_assert(std::is_nothrow_copy_constructible<identifier_t>(), "To WATCH, the ID must be safe to copy.");
@@ -80,9 +375,16 @@ struct element_versioning_gt {
         generation_t generation {0};
     };
 
+    /**
+     * @brief Generation and the deletion flag of a watched entry, folded into a single word,
+     * so that the watches of large transactions take just the identifier and 8 bytes.
+     */
     struct watch_t {
-        generation_t generation {0};
-        bool deleted {false};
+        generation_t generation : 63;
+        bool deleted : 1;
+
+        watch_t(generation_t generation = 0, bool deleted = false) noexcept
+            : generation(generation), deleted(deleted) {}
 
         bool operator==(watch_t const& watch) const noexcept {
             return watch.deleted == deleted && watch.generation == generation;
@@ -97,37 +399,75 @@ struct element_versioning_gt {
         watch_t watch;
     };
 
-    struct entry_t {
-        mutable element_t element;
-        mutable generation_t generation {0};
-        mutable bool deleted {false};
-        mutable bool visible {true};
+    /**
+     * @brief Entries of comparators with a `prefix` member cache the prefix of their
+     * element. Whoever writes the `element` directly must `refresh()` it afterwards,
+     * passing the comparator of the container.
+     */
+    struct entry_t : public entry_fields_gt<element_t, generation_t, layout_t>, public entry_prefix_gt<prefix_t> {
+        using fields_t = entry_fields_gt<element_t, generation_t, layout_t>;
 
         entry_t() = default;
         entry_t(entry_t&&) noexcept = default;
         entry_t& operator=(entry_t&&) noexcept = default;
         entry_t(entry_t const&) noexcept = delete;
         entry_t& operator=(entry_t const&) noexcept = delete;
-        entry_t(element_t&& element) noexcept : element(std::move(element)) {}
+        entry_t(element_t&& element, comparator_t const& comparator = {}) noexcept : fields_t(std::move(element)) {
+            refresh(comparator);
+        }
 
-        operator element_t const&() const& noexcept { return element; }
+        void refresh(comparator_t const& comparator) const noexcept {
+            if constexpr (prefixed_k)
+                this->prefix = comparator.prefix(this->element);
+        }
+
+        operator element_t const&() const& noexcept { return this->element; }
         bool operator==(watch_t const& watch) const noexcept {
-            return watch.deleted == deleted && watch.generation == generation;
+            return watch.deleted == this->deleted && watch.generation == this->generation;
         }
         bool operator!=(watch_t const& watch) const noexcept {
-            return watch.deleted != deleted || watch.generation != generation;
+            return watch.deleted != this->deleted || watch.generation != this->generation;
         }
     };
 
+    /**
+     * @brief A lookup key with a precomputed prefix, so that descents
+     * don't normalize the same key at every visited node.
+     */
+    template <typename comparable_at>
+    struct prefixed_gt {
+        prefix_t prefix;
+        comparable_at const& comparable;
+    };
+
+    template <typename at>
+    struct is_prefixed : std::false_type {};
+    template <typename at>
+    struct is_prefixed<prefixed_gt<at>> : std::true_type {};
+
+    template <typename at>
+    constexpr static bool knows_prefix() {
+        using t = std::remove_reference_t<at>;
+        return prefixed_k && (std::is_same<t, entry_t>() || is_prefixed<t>());
+    }
+
     template <typename at>
     constexpr static bool knows_generation() {
         using t = std::remove_reference_t<at>;
         return std::is_same<t, entry_t>() || std::is_same<t, dated_identifier_t>();
     }
 
-    struct entry_comparator_t {
+    /**
+     * @brief Extends the user-provided comparator, that it keeps an instance of,
+     * to entries with generations and precomputed prefixes.
+     */
+    struct entry_comparator_t : private functor_holder_gt<comparator_t> {
         using is_transparent = void;
 
+        entry_comparator_t() = default;
+        entry_comparator_t(comparator_t const& comparator) noexcept : functor_holder_gt<comparator_t>(comparator) {}
+        comparator_t const& comparator() const noexcept { return this->functor(); }
+
         template <typename at>
         decltype(auto) comparable(at const& object) const noexcept {
             using t = std::remove_reference_t<at>;
@@ -135,13 +475,28 @@ struct element_versioning_gt {
                 return (element_t const&)object.element;
             else if constexpr (std::is_same<t, dated_identifier_t>())
                 return (identifier_t const&)object.id;
+            else if constexpr (is_prefixed<t>())
+                return comparable(object.comparable);
             else
                 return (t const&)object;
         }
 
+        /**
+         * @brief Wraps a lookup key with its prefix, if the comparator normalizes keys.
+         * Otherwise, returns the key itself.
+         */
+        template <typename at>
+        decltype(auto) prefixed(at const& object) const noexcept {
+            using t = std::remove_reference_t<at>;
+            if constexpr (prefixed_k && !knows_prefix<t>() && !std::is_same<t, dated_identifier_t>())
+                return prefixed_gt<t> {comparator().prefix(object), object};
+            else
+                return (at const&)object;
+        }
+
         template <typename first_at, typename second_at>
         bool dated_compare(first_at const& a, second_at const& b) const noexcept {
-            comparator_t less;
+            comparator_t const& less = comparator();
             auto a_less_b = less(comparable(a), comparable(b));
             auto b_less_a = less(comparable(b), comparable(a));
             return !a_less_b && !b_less_a ? a.generation < b.generation : a_less_b;
@@ -149,13 +504,16 @@ struct element_versioning_gt {
 
         template <typename first_at, typename second_at>
         bool native_compare(first_at const& a, second_at const& b) const noexcept {
-            return comparator_t {}(comparable(a), comparable(b));
+            return comparator()(comparable(a), comparable(b));
         }
 
         template <typename first_at, typename second_at>
         bool less(first_at const& a, second_at const& b) const noexcept {
             using first_t = std::remove_reference_t<first_at>;
             using second_t = std::remove_reference_t<second_at>;
+            if constexpr (knows_prefix<first_t>() && knows_prefix<second_t>())
+                if (a.prefix != b.prefix)
+                    return a.prefix < b.prefix;
             if constexpr (knows_generation<first_t>() && knows_generation<second_t>())
                 return dated_compare(a, b);
             else
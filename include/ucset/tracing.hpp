@@ -0,0 +1,308 @@
+#pragma once
+#include <array>   // `std::array` for ring buffers
+#include <chrono>  // `std::chrono::steady_clock` for timestamps
+#include <memory>  // `std::allocator_traits`
+#include <mutex>   // `std::mutex` for the rings registry
+#include <ostream> // `std::ostream` for dumps
+#include <vector>  // `std::vector` for the rings registry
+
+#include "status.hpp"
+
+namespace unum::ucset {
+
+/**
+ * @brief Hot-path boundaries, that can be reported to a tracer.
+ * Every event is emitted twice - on the way in and on the way out.
+ */
+enum class trace_event_t : std::uint8_t {
+    find_k,
+    upper_bound_k,
+    range_k,
+    upsert_k,
+    stage_k,
+    commit_k,
+    acquire_k,
+    hold_k,
+    allocate_k,
+};
+
+inline char const* trace_event_name(trace_event_t event) noexcept {
+    switch (event) {
+    case trace_event_t::find_k: return "find";
+    case trace_event_t::upper_bound_k: return "upper_bound";
+    case trace_event_t::range_k: return "range";
+    case trace_event_t::upsert_k: return "upsert";
+    case trace_event_t::stage_k: return "stage";
+    case trace_event_t::commit_k: return "commit";
+    case trace_event_t::acquire_k: return "acquire";
+    case trace_event_t::hold_k: return "hold";
+    case trace_event_t::allocate_k: return "allocate";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Default tracing policy, that compiles to nothing.
+ *
+ * Any other tracer must provide the same two static functions.
+ * The @p argument is event-specific: a generation for `stage` and `commit`,
+ * a partition index for locks, or the number of bytes for allocations.
+ */
+struct no_tracer_t {
+    static constexpr void begin(trace_event_t, std::uint64_t = 0) noexcept {}
+    static constexpr void end(trace_event_t, std::uint64_t = 0) noexcept {}
+};
+
+/**
+ * @brief RAII helper, that emits the `begin` and `end` events around a scope.
+ */
+template <typename tracer_at>
+class trace_scope_gt {
+    trace_event_t event_;
+    std::uint64_t argument_;
+
+  public:
+    trace_scope_gt(trace_event_t event, std::uint64_t argument = 0) noexcept : event_(event), argument_(argument) {
+        tracer_at::begin(event_, argument_);
+    }
+    ~trace_scope_gt() noexcept { tracer_at::end(event_, argument_); }
+    trace_scope_gt(trace_scope_gt const&) = delete;
+    trace_scope_gt& operator=(trace_scope_gt const&) = delete;
+};
+
+/**
+ * @brief Wraps STL-like locks, reporting the time spent waiting for
+ * the mutex as `acquire_k` and the time spent owning it as `hold_k`.
+ */
+template <typename lock_at, typename tracer_at>
+class traced_lock_gt {
+    std::uint64_t argument_;
+    lock_at lock_;
+
+    template <typename mutex_at, typename... tags_at>
+    static lock_at acquire(std::uint64_t argument, mutex_at& mutex, tags_at... tags) noexcept {
+        trace_scope_gt<tracer_at> _ {trace_event_t::acquire_k, argument};
+        return lock_at {mutex, tags...};
+    }
+
+  public:
+    template <typename mutex_at>
+    traced_lock_gt(mutex_at& mutex, std::uint64_t argument = 0) noexcept
+        : argument_(argument), lock_(acquire(argument, mutex)) {
+        tracer_at::begin(trace_event_t::hold_k, argument_);
+    }
+
+    template <typename mutex_at>
+    traced_lock_gt(mutex_at& mutex, std::try_to_lock_t tag, std::uint64_t argument = 0) noexcept
+        : argument_(argument), lock_(acquire(argument, mutex, tag)) {
+        if (lock_)
+            tracer_at::begin(trace_event_t::hold_k, argument_);
+    }
+
+    ~traced_lock_gt() noexcept {
+        if (lock_)
+            tracer_at::end(trace_event_t::hold_k, argument_);
+    }
+
+    traced_lock_gt(traced_lock_gt const&) = delete;
+    traced_lock_gt& operator=(traced_lock_gt const&) = delete;
+    explicit operator bool() const noexcept { return static_cast<bool>(lock_); }
+};
+
+/**
+ * @brief Wraps any STL-compatible allocator, reporting every
+ * allocation as an `allocate_k` event with the number of bytes.
+ */
+template <typename allocator_at, typename tracer_at>
+class traced_allocator_gt : public allocator_at {
+    using traits_t = std::allocator_traits<allocator_at>;
+
+  public:
+    using value_type = typename traits_t::value_type;
+    using allocator_t = allocator_at;
+
+    template <typename other_at>
+    struct rebind {
+        using other = traced_allocator_gt<typename traits_t::template rebind_alloc<other_at>, tracer_at>;
+    };
+
+    traced_allocator_gt() = default;
+    traced_allocator_gt(allocator_t const& allocator) noexcept : allocator_t(allocator) {}
+    template <typename other_at>
+    traced_allocator_gt(traced_allocator_gt<other_at, tracer_at> const& other) noexcept
+        : allocator_t(other.inner()) {}
+
+    allocator_t const& inner() const noexcept { return *this; }
+
+    value_type* allocate(std::size_t n) {
+        trace_scope_gt<tracer_at> _ {trace_event_t::allocate_k, n * sizeof(value_type)};
+        return traits_t::allocate(*this, n);
+    }
+
+    void deallocate(value_type* pointer, std::size_t n) noexcept { traits_t::deallocate(*this, pointer, n); }
+
+    template <typename other_at>
+    bool operator==(traced_allocator_gt<other_at, tracer_at> const& other) const noexcept {
+        return inner() == other.inner();
+    }
+    template <typename other_at>
+    bool operator!=(traced_allocator_gt<other_at, tracer_at> const& other) const noexcept {
+        return inner() != other.inner();
+    }
+};
+
+/**
+ * @brief Built-in tracer, that logs events into per-thread ring buffers,
+ * which can later be dumped as Chrome/Perfetto-compatible JSON.
+ *
+ * Every thread lazily registers its own ring on the first event.
+ * If the registration fails, that thread silently skips all events.
+ * Once the ring is full, the oldest events are overwritten. Rings of exited
+ * threads keep their events until those are dumped or cleared, and are then
+ * reused by new threads, so churning thread pools don't grow the registry.
+ *
+ * @tparam capacity_ak  Number of events each thread can remember.
+ */
+template <std::size_t capacity_ak = 1ul << 14>
+class ring_tracer_gt {
+
+  public:
+    static constexpr std::size_t capacity_k = capacity_ak;
+
+    struct record_t {
+        std::uint64_t nanoseconds {0};
+        std::uint64_t argument {0};
+        trace_event_t event {trace_event_t::find_k};
+        bool begin {false};
+    };
+
+  private:
+    struct ring_t {
+        std::array<record_t, capacity_k> records;
+        std::size_t count {0};
+        std::size_t thread {0};
+        /// The owning thread has exited.
+        bool retired {false};
+        /// The events were exported after the owning thread has exited.
+        bool dumped {false};
+
+        bool reusable() const noexcept { return retired && (dumped || !count); }
+    };
+
+    struct registry_t {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ring_t>> rings;
+        std::size_t threads {0};
+        std::chrono::steady_clock::time_point start {std::chrono::steady_clock::now()};
+    };
+
+    /**
+     * @brief Retires the ring of the current thread, once it exits.
+     */
+    struct owner_t {
+        ring_t* ring {register_ring()};
+
+        ~owner_t() noexcept {
+            if (!ring)
+                return;
+            auto& registry = ring_tracer_gt::registry();
+            std::unique_lock _ {registry.mutex};
+            ring->retired = true;
+        }
+    };
+
+    static registry_t& registry() noexcept {
+        static registry_t registry;
+        return registry;
+    }
+
+    static ring_t* register_ring() noexcept {
+        ring_t* result = nullptr;
+        auto& registry = ring_tracer_gt::registry();
+        invoke_safely([&] {
+            std::unique_lock lock {registry.mutex};
+            for (auto const& ring : registry.rings)
+                if (ring->reusable()) {
+                    ring->count = 0;
+                    ring->retired = ring->dumped = false;
+                    ring->thread = registry.threads++;
+                    result = ring.get();
+                    return;
+                }
+
+            lock.unlock();
+            std::unique_ptr<ring_t> ring {new ring_t};
+            lock.lock();
+            ring->thread = registry.threads++;
+            registry.rings.push_back(std::move(ring));
+            result = registry.rings.back().get();
+        });
+        return result;
+    }
+
+    static ring_t* thread_ring() noexcept {
+        thread_local owner_t owner;
+        return owner.ring;
+    }
+
+    static void record(trace_event_t event, std::uint64_t argument, bool begin) noexcept {
+        ring_t* ring = thread_ring();
+        if (!ring)
+            return;
+        auto elapsed = std::chrono::steady_clock::now() - registry().start;
+        auto& record = ring->records[ring->count % capacity_k];
+        record.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        record.argument = argument;
+        record.event = event;
+        record.begin = begin;
+        ++ring->count;
+    }
+
+  public:
+    static void begin(trace_event_t event, std::uint64_t argument = 0) noexcept { record(event, argument, true); }
+    static void end(trace_event_t event, std::uint64_t argument = 0) noexcept { record(event, argument, false); }
+
+    /**
+     * @brief Exports all the remembered events in the "Trace Event Format",
+     * understood by `chrome://tracing` and `ui.perfetto.dev`.
+     * The rings aren't synchronized, so prefer dumping when other threads are idle.
+     */
+    [[nodiscard]] static status_t dump_chrome_json(std::ostream& output) noexcept {
+        auto& registry = ring_tracer_gt::registry();
+        return invoke_safely([&] {
+            std::unique_lock _ {registry.mutex};
+            char const* separator = "";
+            output << "{\"traceEvents\":[";
+            for (auto const& ring : registry.rings) {
+                std::size_t first = ring->count > capacity_k ? ring->count - capacity_k : 0;
+                for (std::size_t idx = first; idx != ring->count; ++idx) {
+                    record_t const& record = ring->records[idx % capacity_k];
+                    output << separator << "{\"name\":\"" << trace_event_name(record.event) << "\""
+                           << ",\"cat\":\"ucset\",\"ph\":\"" << (record.begin ? 'B' : 'E') << "\""
+                           << ",\"ts\":" << record.nanoseconds / 1000 << "."
+                           << char('0' + record.nanoseconds / 100 % 10) << char('0' + record.nanoseconds / 10 % 10)
+                           << char('0' + record.nanoseconds % 10)
+                           << ",\"pid\":0,\"tid\":" << ring->thread //
+                           << ",\"args\":{\"argument\":" << record.argument << "}}";
+                    separator = ",";
+                }
+                ring->dumped = ring->retired;
+            }
+            output << "]}";
+        });
+    }
+
+    /**
+     * @brief Forgets all the events, but keeps the rings allocated for reuse.
+     */
+    static void clear() noexcept {
+        auto& registry = ring_tracer_gt::registry();
+        invoke_safely([&] {
+            std::unique_lock _ {registry.mutex};
+            for (auto const& ring : registry.rings)
+                ring->count = 0;
+        });
+    }
+};
+
+} // namespace unum::ucset
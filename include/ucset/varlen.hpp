@@ -0,0 +1,150 @@
+#pragma once
+#include <cstdint>     // `std::uint32_t`
+#include <cstring>     // `std::memcpy`
+#include <memory>      // `std::allocator_traits`
+#include <string_view> // `std::string_view`
+#include <utility>     // `std::exchange`
+
+#include "status.hpp"
+
+namespace unum::ucset {
+
+/**
+ * @brief Variable-length key-value record, that keeps short records inline,
+ * right in the tree node, and spills longer ones into a buffer from @p allocator_at.
+ * Pass an `arena_allocator_gt` bound to the same arena as the container,
+ * and the spilled bytes end up in the container-owned arena, next to the nodes.
+ *
+ * Moves never allocate, so the records satisfy the `noexcept` requirements of
+ * the containers. Construction and copies may throw `std::bad_alloc`, just like
+ * `std::string`, but it happens outside of the container, before the `upsert`.
+ * Identifiers are `std::string_view`s, so the keys passed to transactional
+ * `watch` and `erase` must outlive the transaction.
+ *
+ * @tparam inline_ak    Bytes of the key and value, that fit without spilling.
+ */
+template <std::size_t inline_ak = 32, typename allocator_at = std::allocator<char>>
+class varlen_gt : private allocator_at {
+    using traits_t = std::allocator_traits<allocator_at>;
+    static_assert(std::is_same<typename traits_t::value_type, char>(), "Bytes are allocated as `char`.");
+    static_assert(inline_ak >= sizeof(char*), "Inline buffer must fit the spilled pointer.");
+
+  public:
+    using allocator_t = allocator_at;
+    static constexpr std::size_t inline_k = inline_ak;
+
+  private:
+    std::uint32_t key_length_ {0};
+    std::uint32_t value_length_ {0};
+    union {
+        char inline_[inline_k];
+        char* spilled_;
+    };
+
+    std::size_t length() const noexcept { return std::size_t(key_length_) + value_length_; }
+    bool spilled() const noexcept { return length() > inline_k; }
+    char const* data() const noexcept { return spilled() ? spilled_ : inline_; }
+
+    void assign(std::string_view key, std::string_view value) {
+        char* target = inline_;
+        if (key.size() + value.size() > inline_k)
+            target = spilled_ = traits_t::allocate(*this, key.size() + value.size());
+        key_length_ = static_cast<std::uint32_t>(key.size());
+        value_length_ = static_cast<std::uint32_t>(value.size());
+        if (key.size())
+            std::memcpy(target, key.data(), key.size());
+        if (value.size())
+            std::memcpy(target + key.size(), value.data(), value.size());
+    }
+
+    void release() noexcept {
+        if (spilled())
+            traits_t::deallocate(*this, spilled_, length());
+        key_length_ = value_length_ = 0;
+    }
+
+    void steal(varlen_gt& other) noexcept {
+        std::memcpy(inline_, other.inline_, inline_k);
+        key_length_ = std::exchange(other.key_length_, 0);
+        value_length_ = std::exchange(other.value_length_, 0);
+    }
+
+  public:
+    varlen_gt() noexcept : inline_ {} {}
+    varlen_gt(std::string_view key, std::string_view value = {}, allocator_t const& allocator = {})
+        : allocator_t(allocator), inline_ {} {
+        assign(key, value);
+    }
+    varlen_gt(varlen_gt const& other) : allocator_t(other.allocator()), inline_ {} {
+        assign(other.key(), other.value());
+    }
+    varlen_gt(varlen_gt&& other) noexcept : allocator_t(other.allocator()) { steal(other); }
+    ~varlen_gt() noexcept { release(); }
+
+    varlen_gt& operator=(varlen_gt const& other) {
+        if (this != &other)
+            *this = varlen_gt(other);
+        return *this;
+    }
+
+    /**
+     * @brief Takes over the bytes together with their allocator,
+     * so records from different arenas can be assigned to each other.
+     */
+    varlen_gt& operator=(varlen_gt&& other) noexcept {
+        if (this == &other)
+            return *this;
+        release();
+        static_cast<allocator_t&>(*this) = other.allocator();
+        steal(other);
+        return *this;
+    }
+
+    allocator_t const& allocator() const noexcept { return *this; }
+    std::string_view key() const noexcept { return {data(), key_length_}; }
+    std::string_view value() const noexcept { return {data() + key_length_, value_length_}; }
+    bool inlined() const noexcept { return !spilled(); }
+    operator std::string_view() const noexcept { return key(); }
+};
+
+/**
+ * @brief Non-owning key-value record, that engines decoding records on the fly,
+ * like `front_coded_gt`, accept in upserts and pass to callbacks.
+ * Views passed to callbacks are only valid until the callback returns.
+ */
+struct varlen_view_t {
+    std::string_view key_;
+    std::string_view value_;
+
+    varlen_view_t() = default;
+    varlen_view_t(std::string_view key, std::string_view value = {}) noexcept : key_(key), value_(value) {}
+    std::string_view key() const noexcept { return key_; }
+    std::string_view value() const noexcept { return value_; }
+    operator std::string_view() const noexcept { return key_; }
+};
+
+/**
+ * @brief Orders records by their keys, and accepts `std::string_view`
+ * for heterogeneous lookups. Big-endian packing of the first 8 bytes
+ * preserves the lexicographic order, so most comparisons are resolved
+ * by the prefixes cached in the entries, without touching spilled bytes.
+ */
+struct varlen_compare_t {
+    using value_type = std::string_view;
+
+    template <typename first_at, typename second_at>
+    bool operator()(first_at const& a, second_at const& b) const noexcept {
+        return std::string_view(a) < std::string_view(b);
+    }
+
+    template <typename key_at>
+    std::uint64_t prefix(key_at const& key) const noexcept {
+        std::string_view view(key);
+        std::uint64_t result = 0;
+        for (std::size_t idx = 0; idx != sizeof(result); ++idx)
+            result = (result << 8) | (idx < view.size() ? static_cast<std::uint8_t>(view[idx]) : 0u);
+        return result;
+    }
+};
+
+} // namespace unum::ucset
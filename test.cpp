@@ -1,10 +1,24 @@
 #include <iostream>
+#include <numeric>
+#include <random>
 #include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <ctime>
 
+#include <ucset/allocators.hpp>
+#include <ucset/columns.hpp>
+#include <ucset/arena.hpp>
 #include <ucset/consistent_set.hpp>
 #include <ucset/consistent_avl.hpp>
+#include <ucset/front_coded.hpp>
+#include <ucset/latencies.hpp>
+#include <ucset/locked.hpp>
+#include <ucset/partitioned.hpp>
+#include <ucset/tracing.hpp>
+#include <ucset/varlen.hpp>
 #include <gtest/gtest.h>
 
 using namespace unum::ucset;
@@ -272,6 +286,1336 @@ TEST(test_avl, clear) {
     EXPECT_EQ(avl.size(), 0);
 }
 
+TEST(tracing, ring_tracer) {
+    using tracer_t = ring_tracer_gt<1024>;
+    using traced_avl_t = locked_gt<consistent_avl_gt<pair_t, pair_compare_t, std::allocator<std::uint8_t>, tracer_t>>;
+    tracer_t::clear();
+    auto avl = *traced_avl_t::make();
+
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(avl.upsert(pair_t {idx, idx}));
+    EXPECT_TRUE(avl.find(size / 2, [](auto const&) noexcept {}));
+
+    auto txn = *avl.transaction();
+    EXPECT_TRUE(txn.upsert(pair_t {size, size}));
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+
+    std::stringstream json;
+    EXPECT_TRUE(tracer_t::dump_chrome_json(json));
+    auto dump = json.str();
+    EXPECT_EQ(dump.front(), '{');
+    EXPECT_EQ(dump.back(), '}');
+    for (char const* name : {"\"find\"", "\"upsert\"", "\"stage\"", "\"commit\"", "\"hold\"", "\"allocate\""})
+        EXPECT_NE(dump.find(name), std::string::npos) << name;
+}
+
+TEST(tracing, exited_threads) {
+    using tracer_t = ring_tracer_gt<64>;
+    auto dump = [] {
+        std::stringstream json;
+        EXPECT_TRUE(tracer_t::dump_chrome_json(json));
+        return json.str();
+    };
+    auto emit = [](trace_event_t event) {
+        std::thread([=] { tracer_t::begin(event), tracer_t::end(event); }).join();
+    };
+
+    // Events of exited threads survive until the first dump.
+    emit(trace_event_t::find_k);
+    EXPECT_NE(dump().find("\"find\""), std::string::npos);
+
+    // Afterwards, their rings are handed to new threads, instead of allocating more.
+    for (std::size_t thread = 0; thread != size; ++thread)
+        emit(trace_event_t::upsert_k), dump();
+    emit(trace_event_t::commit_k);
+    auto last = dump();
+    EXPECT_EQ(last.find("\"find\""), std::string::npos);
+    EXPECT_EQ(last.find("\"upsert\""), std::string::npos);
+    EXPECT_NE(last.find("\"commit\""), std::string::npos);
+}
+
+template <typename measured_t>
+void test_latencies() {
+    auto container = *measured_t::make();
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(container.upsert(pair_t {idx, idx}));
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(container.find(idx, [](auto const&) noexcept {}));
+    EXPECT_TRUE(container.range(0, size, [](auto const&) noexcept {}));
+
+    auto txn = *container.transaction();
+    EXPECT_TRUE(txn.upsert(pair_t {size, size}));
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+
+    auto upserts = container.latencies(latency_operation_t::upsert_k);
+    EXPECT_EQ(upserts.count(), size);
+    EXPECT_LE(upserts.percentile(0.5), upserts.percentile(0.99));
+    EXPECT_LE(upserts.percentile(0.99), upserts.max());
+    EXPECT_EQ(container.latencies(latency_operation_t::find_k).count(), size);
+    EXPECT_EQ(container.latencies(latency_operation_t::range_per_element_k).count(), 1u);
+    EXPECT_EQ(container.latencies(latency_operation_t::stage_k).count(), 1u);
+    EXPECT_EQ(container.latencies(latency_operation_t::commit_k).count(), 1u);
+}
+
+TEST(latencies, histograms) {
+    for (std::uint64_t ticks : {0ul, 7ul, 8ul, 1000ul, 123456789ul}) {
+        auto floor = latency_histogram_t::bucket_floor(latency_histogram_t::bucket(ticks));
+        EXPECT_LE(floor, ticks);
+        EXPECT_GE(floor, ticks - ticks / latency_histogram_t::sub_buckets_k);
+    }
+
+    using histograms_t = latency_histograms_gt<>;
+    test_latencies<locked_gt<avl_t, std::shared_mutex, no_tracer_t, histograms_t>>();
+    test_latencies<partitioned_gt<avl_t, std::hash<std::size_t>, std::shared_mutex, 16, no_tracer_t, histograms_t>>();
+
+    // Threads beyond the number of shards share them, without losing records.
+    latency_histograms_gt<2> shared;
+    std::vector<std::thread> threads;
+    for (std::size_t thread = 0; thread != 8; ++thread)
+        threads.emplace_back([&] {
+            for (std::size_t idx = 0; idx != size * 1024; ++idx)
+                shared.record(latency_operation_t::find_k, 100);
+        });
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ(shared.merged(latency_operation_t::find_k).count(), size * 1024 * 8);
+}
+
+template <typename counted_t>
+void test_failing_allocations() {
+    using allocator_t = typename counted_t::allocator_t;
+    auto& counters = allocator_t::counters();
+    counters.reset();
+
+    auto container = *counted_t::make();
+    {
+        allocation_site_t _ {"upsert"};
+        for (std::size_t idx = 0; idx < size; ++idx)
+            EXPECT_TRUE(container.upsert(pair_t {idx, idx}));
+    }
+    EXPECT_GE(counters.stats("upsert").allocations, size);
+
+    // Failing in the middle of a batch must leave the container untouched.
+    std::vector<pair_t> batch;
+    for (std::size_t idx = 0; idx < size; ++idx)
+        batch.push_back(pair_t {size + idx, idx});
+    counters.fail_nth(size / 2);
+    EXPECT_EQ(container.upsert(batch.begin(), batch.end()).errc, out_of_memory_heap_k);
+    EXPECT_EQ(container.size(), size);
+    EXPECT_EQ(counters.total().failures, 1u);
+    EXPECT_TRUE(container.upsert(batch.begin(), batch.end()));
+    EXPECT_EQ(container.size(), size * 2);
+
+    // Once out of budget, transactions must fail gracefully as well.
+    counters.fail_above(counters.live_bytes());
+    auto txn = *container.transaction();
+    EXPECT_EQ(txn.upsert(pair_t {size * 2, 0}).errc, out_of_memory_heap_k);
+    EXPECT_FALSE(txn.watch(0));
+    counters.reset();
+    EXPECT_TRUE(txn.upsert(pair_t {size * 2, 0}));
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+}
+
+TEST(allocators, failing) {
+    struct stl_tag_t {};
+    struct avl_tag_t {};
+    using stl_counting_t = counting_allocator_gt<std::allocator<std::uint8_t>, stl_tag_t>;
+    using avl_counting_t = counting_allocator_gt<std::allocator<std::uint8_t>, avl_tag_t>;
+    test_failing_allocations<consistent_set_gt<pair_t, pair_compare_t, stl_counting_t>>();
+    test_failing_allocations<consistent_avl_gt<pair_t, pair_compare_t, avl_counting_t>>();
+}
+
+template <typename budgeted_t>
+void test_memory_budget() {
+    auto container = *budgeted_t::make();
+    EXPECT_EQ(container.memory_limit(), memory_budget_t::unlimited_k);
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(container.upsert(pair_t {idx, idx}));
+    std::size_t usage = container.memory_usage();
+    EXPECT_GT(usage, 0u);
+
+    // Past the limit the container stays intact.
+    container.limit_memory(usage);
+    EXPECT_EQ(container.upsert(pair_t {size, size}).errc, out_of_memory_arena_k);
+    std::vector<pair_t> batch {pair_t {size, size}, pair_t {size + 1, size}};
+    EXPECT_EQ(container.upsert(batch.begin(), batch.end()).errc, out_of_memory_arena_k);
+    EXPECT_FALSE(container.transaction());
+    EXPECT_EQ(container.size(), size);
+    EXPECT_EQ(container.memory_usage(), usage);
+
+    // The limit can be raised at runtime.
+    container.limit_memory(usage * 2);
+    EXPECT_TRUE(container.upsert(pair_t {size, size}));
+    EXPECT_EQ(container.size(), size + 1);
+    EXPECT_LE(container.memory_usage(), container.memory_limit());
+
+    // Staging needs memory for the watches as well.
+    auto txn = *container.transaction();
+    EXPECT_TRUE(txn.upsert(pair_t {size + 1, size}));
+    container.limit_memory(container.memory_usage());
+    EXPECT_EQ(txn.stage().errc, out_of_memory_arena_k);
+    container.limit_memory(memory_budget_t::unlimited_k);
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+    EXPECT_EQ(container.size(), size + 2);
+}
+
+TEST(allocators, memory_budget) {
+    test_memory_budget<stl_t>();
+    test_memory_budget<avl_t>();
+    test_memory_budget<locked_gt<avl_t>>();
+
+    // Partitioned containers share one budget between their parts.
+    using partitioned_t = partitioned_gt<avl_t>;
+    auto partitioned = *partitioned_t::make();
+    partitioned.limit_memory(0);
+    EXPECT_EQ(partitioned.memory_limit(), 0u);
+    EXPECT_EQ(partitioned.upsert(pair_t {1, 1}).errc, out_of_memory_arena_k);
+    std::vector<pair_t> batch {pair_t {1, 1}};
+    EXPECT_EQ(partitioned.upsert(batch.begin(), batch.end()).errc, out_of_memory_arena_k);
+    EXPECT_FALSE(partitioned.transaction());
+    partitioned.limit_memory(memory_budget_t::unlimited_k);
+    EXPECT_TRUE(partitioned.upsert(pair_t {1, 1}));
+    EXPECT_GT(partitioned.memory_usage(), 0u);
+
+    // Keys, that all land into one part, can still use the whole budget.
+    auto single = *avl_t::make();
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(single.upsert(pair_t {idx * partitioned_t::parts_k, idx}));
+    auto skewed = *partitioned_t::make();
+    skewed.limit_memory(single.memory_usage());
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(skewed.upsert(pair_t {idx * partitioned_t::parts_k, idx}));
+    EXPECT_EQ(skewed.memory_usage(), single.memory_usage());
+    EXPECT_EQ(skewed.upsert(pair_t {1, 1}).errc, out_of_memory_arena_k);
+    EXPECT_TRUE(skewed.erase_range(0, 1, no_op_t {}));
+    EXPECT_TRUE(skewed.upsert(pair_t {1, 1}));
+}
+
+TEST(allocators, arena) {
+    arena_config_t config;
+    config.region_bytes = 1ul << 20;
+    config.numa_node = 0;
+    arena_t arena {config};
+
+    using arena_avl_t = consistent_avl_gt<pair_t, pair_compare_t, arena_allocator_gt<>>;
+    {
+        auto avl = *arena_avl_t::make(arena);
+        for (std::size_t idx = 0; idx < size * 64; ++idx)
+            EXPECT_TRUE(avl.upsert(pair_t {idx, idx}));
+        auto txn = *avl.transaction();
+        EXPECT_TRUE(txn.watch(0));
+        EXPECT_TRUE(txn.upsert(pair_t {0, 1}));
+        EXPECT_TRUE(txn.stage());
+        EXPECT_TRUE(txn.commit());
+        EXPECT_EQ(avl.size(), size * 64);
+        EXPECT_GE(arena.mapped_bytes(), config.region_bytes);
+    }
+
+    // Every part can have an arena of its own, potentially on a different NUMA node.
+    std::array<arena_t, 4> part_arenas;
+    using arena_partitioned_t = partitioned_gt<arena_avl_t, std::hash<std::size_t>, std::shared_mutex, 4>;
+    auto partitioned = *arena_partitioned_t::make([&](std::size_t part_idx) noexcept {
+        return arena_allocator_gt<> {part_arenas[part_idx]};
+    });
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(partitioned.upsert(pair_t {idx, idx}));
+    EXPECT_TRUE(partitioned.clear());
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(partitioned.upsert(pair_t {idx, idx}));
+    for (auto const& part_arena : part_arenas)
+        EXPECT_GT(part_arena.mapped_bytes(), 0u);
+}
+
+TEST(allocators, contiguous_large_blocks) {
+    arena_config_t config;
+    config.region_bytes = 1ul << 20;
+    config.contiguous_bytes = 1ul << 24;
+    arena_t arena {config};
+
+    // Large blocks are carved from the same reservation, as the small ones.
+    auto small = static_cast<char*>(arena.allocate(64));
+    auto large = static_cast<char*>(arena.allocate(1ul << 18));
+    ASSERT_TRUE(small && large);
+    EXPECT_LT(std::max(small, large) - std::min(small, large), std::ptrdiff_t(config.contiguous_bytes));
+    std::memset(large, 1, 1ul << 18);
+
+    // Released blocks keep their address range, and adjacent ones merge for bigger requests.
+    auto second = static_cast<char*>(arena.allocate(1ul << 18));
+    std::size_t mapped = arena.mapped_bytes();
+    arena.deallocate(large, 1ul << 18);
+    arena.deallocate(second, 1ul << 18);
+    auto merged = static_cast<char*>(arena.allocate(1ul << 19));
+    EXPECT_EQ(merged, std::min(large, second));
+    EXPECT_EQ(arena.mapped_bytes(), mapped);
+    arena.deallocate(merged, 1ul << 19);
+
+    // Once the reservation is used up, allocations fail instead of mapping memory elsewhere.
+    EXPECT_EQ(arena.allocate(config.contiguous_bytes), nullptr);
+    EXPECT_LE(arena.mapped_bytes(), config.contiguous_bytes);
+    arena.deallocate(small, 64);
+}
+
+TEST(allocators, contiguous_exhaustion) {
+    arena_config_t config;
+    config.region_bytes = 4096;
+    config.huge_pages = false;
+    config.contiguous_bytes = 4096 + 48;
+    arena_t arena {config};
+
+    // Blocks never cross the end of a reservation, that isn't a multiple of the region.
+    char* first = nullptr;
+    char* last = nullptr;
+    while (auto block = static_cast<char*>(arena.allocate(64))) {
+        first = first ? std::min(first, block) : block;
+        last = std::max(last, block);
+    }
+    ASSERT_TRUE(first);
+    EXPECT_LE(last + 64 - first, std::ptrdiff_t(config.contiguous_bytes));
+    EXPECT_EQ(arena.allocate(64), nullptr);
+}
+
+template <typename collection_at>
+void test_shrink_to_fit(arena_t& arena) {
+    auto collection = *collection_at::make(arena);
+    for (std::size_t round = 0; round != 2; ++round)
+        for (std::size_t idx = 0; idx < size * 64; ++idx)
+            EXPECT_TRUE(collection.upsert(pair_t {idx, round}));
+
+    // Transactions keep their buffers across resets, until asked to release them.
+    auto txn = *collection.transaction();
+    for (std::size_t idx = 0; idx < size * 64; ++idx)
+        EXPECT_TRUE(txn.watch(idx));
+    EXPECT_TRUE(txn.reset());
+    std::size_t usage = collection.memory_usage();
+    txn.shrink_to_fit();
+    EXPECT_LT(collection.memory_usage(), usage);
+
+    EXPECT_TRUE(collection.erase_range(size, size * 64, no_op_t {}));
+    EXPECT_EQ(collection.size(), size);
+    usage = collection.memory_usage();
+    std::size_t released = collection.shrink_to_fit();
+    EXPECT_EQ(released, usage - collection.memory_usage());
+    EXPECT_GT(arena.trim(), 0u);
+    EXPECT_EQ(arena.trim(), 0u);
+
+    // Trimmed pages are reused, before mapping new regions.
+    std::size_t mapped = arena.mapped_bytes();
+    for (std::size_t idx = size; idx < size * 64; ++idx)
+        EXPECT_TRUE(collection.upsert(pair_t {idx, idx}));
+    EXPECT_EQ(arena.mapped_bytes(), mapped);
+    for (std::size_t idx = 0; idx < size * 64; idx += size)
+        EXPECT_TRUE(collection.find(idx, [&](pair_t const& pair) noexcept { EXPECT_EQ(pair.value, idx ? idx : 1); }));
+}
+
+TEST(allocators, shrink_to_fit) {
+    arena_config_t config;
+    config.region_bytes = 1ul << 20;
+    config.huge_pages = false;
+    arena_t set_arena {config}, avl_arena {config};
+    test_shrink_to_fit<consistent_set_gt<pair_t, pair_compare_t, arena_allocator_gt<>>>(set_arena);
+    test_shrink_to_fit<consistent_avl_gt<pair_t, pair_compare_t, arena_allocator_gt<>>>(avl_arena);
+
+    // Set nodes of overwritten entries are pooled, until the container is shrunk.
+    auto set = *stl_t::make();
+    for (std::size_t round = 0; round != 2; ++round)
+        for (std::size_t idx = 0; idx < size; ++idx)
+            EXPECT_TRUE(set.upsert(pair_t {idx, round}));
+    EXPECT_GT(set.shrink_to_fit(), 0u);
+    EXPECT_EQ(set.shrink_to_fit(), 0u);
+
+    auto locked = *locked_gt<stl_t>::make();
+    auto partitioned = *partitioned_gt<stl_t>::make();
+    for (std::size_t round = 0; round != 2; ++round)
+        for (std::size_t idx = 0; idx < size; ++idx) {
+            EXPECT_TRUE(locked.upsert(pair_t {idx, round}));
+            EXPECT_TRUE(partitioned.upsert(pair_t {idx, round}));
+        }
+    EXPECT_GT(locked.shrink_to_fit(), 0u);
+    EXPECT_GT(partitioned.shrink_to_fit(), 0u);
+    EXPECT_EQ(partitioned.size(), size);
+}
+
+template <typename compact_t>
+void test_compact_layout() {
+    auto container = *compact_t::make();
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(container.upsert(pair_t {idx, idx}));
+
+    auto txn = *container.transaction();
+    EXPECT_TRUE(txn.watch(1));
+    EXPECT_TRUE(txn.upsert(pair_t {1, 2}));
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+
+    // The older revision must have been compacted away, once the new one became visible.
+    EXPECT_EQ(container.size(), size);
+    std::size_t value = 0;
+    EXPECT_TRUE(container.find(1, [&](pair_t const& pair) noexcept { value = pair.value; }));
+    EXPECT_EQ(value, 2u);
+
+    // A conflicting transaction must notice the new generation.
+    auto conflicting = *container.transaction();
+    EXPECT_TRUE(conflicting.watch(1));
+    EXPECT_TRUE(container.upsert(pair_t {1, 3}));
+    EXPECT_EQ(conflicting.stage().errc, consistency_k);
+}
+
+TEST(layout, compact) {
+    using padded_t = element_versioning_gt<pair_t, pair_compare_t, padded_layout_t>;
+    using compact_t = element_versioning_gt<pair_t, pair_compare_t, compact_layout_t>;
+    static_assert(sizeof(compact_t::entry_t) == sizeof(pair_t) + sizeof(compact_t::generation_t));
+    static_assert(sizeof(compact_t::entry_t) < sizeof(padded_t::entry_t));
+
+    test_compact_layout<consistent_set_gt<pair_t, pair_compare_t, std::allocator<std::uint8_t>, no_tracer_t, compact_layout_t>>();
+    test_compact_layout<consistent_avl_gt<pair_t, pair_compare_t, std::allocator<std::uint8_t>, no_tracer_t, compact_layout_t>>();
+}
+
+TEST(layout, offset_links) {
+    using compact_t = element_versioning_gt<pair_t, pair_compare_t, compact_layout_t>;
+    using pointer_node_t = avl_node_gt<compact_t::entry_t, compact_t::entry_comparator_t, pointer_links_t>;
+    using offset_node_t = avl_node_gt<compact_t::entry_t, compact_t::entry_comparator_t, offset_links_t>;
+    static_assert(sizeof(offset_node_t) + 8 == sizeof(pointer_node_t));
+
+    arena_config_t config;
+    config.region_bytes = 1ul << 20;
+    config.contiguous_bytes = 1ul << 26;
+    arena_t arena {config};
+    using offset_avl_t =
+        consistent_avl_gt<pair_t, pair_compare_t, arena_allocator_gt<>, no_tracer_t, compact_layout_t, offset_links_t>;
+    auto avl = *offset_avl_t::make(arena);
+
+    std::vector<std::size_t> keys(size * 64);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937 {42});
+    for (std::size_t key : keys)
+        EXPECT_TRUE(avl.upsert(pair_t {key, key}));
+
+    // Rotations re-encode the links, so every node must remain reachable exactly once.
+    std::vector<bool> visited(keys.size());
+    EXPECT_TRUE(avl.range(0, keys.size(), [&](pair_t const& pair) noexcept {
+        EXPECT_FALSE(visited[pair.key]);
+        visited[pair.key] = true;
+    }));
+    EXPECT_EQ(std::count(visited.begin(), visited.end(), true), keys.size());
+    for (std::size_t key : keys)
+        EXPECT_TRUE(avl.find(key, [&](pair_t const& pair) noexcept { EXPECT_EQ(pair.value, key); }));
+
+    EXPECT_LE(arena.mapped_bytes(), config.contiguous_bytes);
+    EXPECT_TRUE(avl.clear());
+
+    // Without a reservation within the reach of the offsets, nodes could end up too far apart.
+    arena_t scattered;
+    EXPECT_FALSE(offset_avl_t::make(scattered));
+    EXPECT_FALSE(offset_avl_t::make());
+    config.contiguous_bytes = offset_links_t::reach_k * 2;
+    arena_t oversized {config};
+    EXPECT_FALSE(offset_avl_t::make(oversized));
+}
+
+TEST(layout, unversioned) {
+    using unversioned_t = element_versioning_gt<pair_t, pair_compare_t, unversioned_layout_t>;
+    static_assert(sizeof(unversioned_t::entry_t) == sizeof(pair_t));
+
+    using unversioned_avl_t =
+        consistent_avl_gt<pair_t, pair_compare_t, std::allocator<std::uint8_t>, no_tracer_t, unversioned_layout_t>;
+    auto avl = *unversioned_avl_t::make();
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(avl.upsert(pair_t {idx, idx}));
+
+    // Overwrites happen in place, with no older revisions left to compact.
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(avl.upsert(pair_t {idx, idx + 1}));
+    std::vector<pair_t> batch {{0, 7}, {size, 7}, {size, 8}};
+    EXPECT_TRUE(avl.upsert(batch.begin(), batch.end()));
+    EXPECT_EQ(avl.size(), size + 1);
+
+    std::size_t value = 0;
+    EXPECT_TRUE(avl.find(0, [&](pair_t const& pair) noexcept { value = pair.value; }));
+    EXPECT_EQ(value, 7u);
+    EXPECT_TRUE(avl.find(size, [&](pair_t const& pair) noexcept { value = pair.value; }));
+    EXPECT_EQ(value, 8u);
+    EXPECT_TRUE(avl.find(1, [&](pair_t const& pair) noexcept { value = pair.value; }));
+    EXPECT_EQ(value, 2u);
+
+    std::size_t count = 0;
+    EXPECT_TRUE(avl.range(0, size, [&](pair_t const&) noexcept { ++count; }));
+    EXPECT_EQ(count, size + 1);
+    EXPECT_TRUE(avl.erase_range(0, size / 2, no_op_t {}));
+    EXPECT_EQ(avl.size(), size / 2 + 1);
+}
+
+TEST(test_avl, upsert_in_place) {
+    auto avl = *avl_t::make();
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(avl.upsert(pair_t {idx, idx}));
+
+    // Overwriting a committed revision must not allocate anything.
+    auto txn = *avl.transaction();
+    EXPECT_TRUE(txn.watch(1));
+    std::size_t usage = avl.memory_usage();
+    EXPECT_TRUE(avl.upsert(pair_t {1, 2}));
+    EXPECT_EQ(avl.memory_usage(), usage);
+    EXPECT_EQ(avl.size(), size);
+    EXPECT_EQ(txn.stage().errc, consistency_k);
+
+    // Pending revisions of the same key disable the fast path.
+    auto pending = *avl.transaction();
+    EXPECT_TRUE(pending.upsert(pair_t {2, 3}));
+    EXPECT_TRUE(pending.stage());
+    EXPECT_TRUE(avl.upsert(pair_t {2, 4}));
+    EXPECT_TRUE(pending.commit());
+
+    std::size_t value = 0;
+    EXPECT_TRUE(avl.find(1, [&](pair_t const& pair) noexcept { value = pair.value; }));
+    EXPECT_EQ(value, 2u);
+    // The plain upsert got a newer generation, than the transaction, and survives its commit.
+    EXPECT_TRUE(avl.find(2, [&](pair_t const& pair) noexcept { value = pair.value; }));
+    EXPECT_EQ(value, 4u);
+}
+
+/// Composite fixed-width key, that is still cheap to copy, but expensive to compare.
+struct name_t {
+    char chars[24] {};
+
+    name_t() = default;
+    name_t(std::string const& string) noexcept { string.copy(chars, sizeof(chars)); }
+    bool operator==(name_t const& other) const noexcept { return std::memcmp(chars, other.chars, sizeof(chars)) == 0; }
+    explicit operator bool() const noexcept { return chars[0] != 0; }
+};
+
+struct name_compare_t {
+    using value_type = name_t;
+    static inline std::size_t full_comparisons = 0;
+    bool operator()(name_t const& a, name_t const& b) const noexcept {
+        return ++full_comparisons, std::memcmp(a.chars, b.chars, sizeof(a.chars)) < 0;
+    }
+};
+
+/// Big-endian packing of the first 8 characters preserves the lexicographic order.
+struct name_prefix_compare_t : public name_compare_t {
+    std::uint64_t prefix(name_t const& key) const noexcept {
+        std::uint64_t result = 0;
+        for (std::size_t idx = 0; idx != 8; ++idx)
+            result = (result << 8) | static_cast<std::uint8_t>(key.chars[idx]);
+        return result;
+    }
+};
+
+template <typename collection_at>
+std::size_t test_name_keys() {
+    auto collection = *collection_at::make();
+    for (std::size_t idx = 0; idx < size; ++idx) {
+        EXPECT_TRUE(collection.upsert(name_t {std::to_string(idx * 7919)}));
+        EXPECT_TRUE(collection.upsert(name_t {"user:" + std::to_string(idx)}));
+    }
+
+    name_compare_t::full_comparisons = 0;
+    for (std::size_t idx = 0; idx < size; ++idx) {
+        name_t expected {std::to_string(idx * 7919)}, found;
+        EXPECT_TRUE(collection.find(expected, [&](name_t const& key) noexcept { found = key; }));
+        EXPECT_EQ(found, expected);
+    }
+    std::size_t count = 0;
+    EXPECT_TRUE(collection.range(name_t {"user:"}, name_t {"user;"}, [&](name_t const&) noexcept { ++count; }));
+    EXPECT_EQ(count, size);
+    return name_compare_t::full_comparisons;
+}
+
+TEST(layout, prefixes) {
+    static_assert(element_versioning_gt<name_t, name_prefix_compare_t>::prefixed_k);
+    static_assert(!element_versioning_gt<name_t, name_compare_t>::prefixed_k);
+
+    // Prefixes resolve most of the comparisons, leaving the comparator for ties.
+    auto plain_avl = test_name_keys<consistent_avl_gt<name_t, name_compare_t>>();
+    auto prefixed_avl = test_name_keys<consistent_avl_gt<name_t, name_prefix_compare_t>>();
+    EXPECT_LT(prefixed_avl * 2, plain_avl);
+    auto plain_set = test_name_keys<consistent_set_gt<name_t, name_compare_t>>();
+    auto prefixed_set = test_name_keys<consistent_set_gt<name_t, name_prefix_compare_t>>();
+    EXPECT_LT(prefixed_set * 2, plain_set);
+}
+
+/// Comparator with a runtime flag, that must be stored, rather than default-constructed per call.
+struct ordered_compare_t {
+    using value_type = std::size_t;
+    bool descending = false;
+    bool operator()(std::size_t a, std::size_t b) const noexcept { return descending ? b < a : a < b; }
+    bool operator()(pair_t a, pair_t b) const noexcept { return operator()(a.key, b.key); }
+    bool operator()(std::size_t a, pair_t b) const noexcept { return operator()(a, b.key); }
+    bool operator()(pair_t a, std::size_t b) const noexcept { return operator()(a.key, b); }
+};
+
+struct salted_hash_t {
+    std::size_t salt = 0;
+    std::size_t operator()(std::size_t key) const noexcept { return std::hash<std::size_t> {}(key ^ salt); }
+};
+
+template <typename collection_at>
+void test_descending(collection_at& collection) {
+    EXPECT_TRUE(collection.comparator().descending);
+    for (std::size_t idx = 1; idx <= size; ++idx)
+        EXPECT_TRUE(collection.upsert(pair_t {idx, idx}));
+
+    for (std::size_t idx = 2; idx <= size; ++idx) {
+        std::size_t next = 0;
+        EXPECT_TRUE(collection.upper_bound(idx, [&](pair_t const& pair) noexcept { next = pair.key; }));
+        EXPECT_EQ(next, idx - 1);
+    }
+    // The zero key is missing and orders last, so inclusive and exclusive ranges agree.
+    std::size_t count = 0;
+    EXPECT_TRUE(collection.range(size, std::size_t(0), [&](pair_t const&) noexcept { ++count; }));
+    EXPECT_EQ(count, size);
+}
+
+TEST(layout, stateful_comparators) {
+    // Stateless functors stay empty bases and add nothing to the containers.
+    static_assert(std::is_empty<typename element_versioning_gt<pair_t, pair_compare_t>::entry_comparator_t>());
+    static_assert(sizeof(partitioned_gt<avl_t>) == sizeof(partitioned_gt<avl_t, salted_hash_t>) - sizeof(std::size_t));
+
+    ordered_compare_t descending {true};
+    auto avl = *consistent_avl_gt<pair_t, ordered_compare_t>::make({}, descending);
+    test_descending(avl);
+    auto set = *consistent_set_gt<pair_t, ordered_compare_t>::make({}, descending);
+    test_descending(set);
+    auto locked = *locked_gt<consistent_avl_gt<pair_t, ordered_compare_t>>::make({}, descending);
+    test_descending(locked);
+
+    using salted_t = partitioned_gt<consistent_avl_gt<pair_t, ordered_compare_t>, salted_hash_t>;
+    auto allocator_for_part = [](std::size_t) noexcept { return std::allocator<std::uint8_t> {}; };
+    auto partitioned = *salted_t::make(allocator_for_part, salted_hash_t {0x9E3779B9}, descending);
+    EXPECT_EQ(partitioned.hash().salt, 0x9E3779B9u);
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(partitioned.upsert(pair_t {idx, idx}));
+    for (std::size_t idx = 1; idx < size; ++idx) {
+        std::size_t next = 0;
+        EXPECT_TRUE(partitioned.find(idx, [](pair_t const&) noexcept {}));
+        EXPECT_TRUE(partitioned.upper_bound(idx, [&](pair_t const& pair) noexcept { next = pair.key; }));
+        EXPECT_EQ(next, idx - 1);
+    }
+}
+
+/// Element with a non-trivial lifetime, that counts its live instances.
+struct counted_t {
+    static inline std::ptrdiff_t live = 0;
+    std::size_t key = 0;
+
+    counted_t(std::size_t key = 0) noexcept : key(key) { ++live; }
+    counted_t(counted_t const& other) noexcept : key(other.key) { ++live; }
+    counted_t(counted_t&& other) noexcept : key(other.key) { ++live; }
+    counted_t& operator=(counted_t const&) noexcept = default;
+    counted_t& operator=(counted_t&&) noexcept = default;
+    ~counted_t() noexcept { --live; }
+    explicit operator std::size_t() const noexcept { return key; }
+};
+
+struct counted_compare_t {
+    using value_type = std::size_t;
+    bool operator()(counted_t const& a, counted_t const& b) const noexcept { return a.key < b.key; }
+    bool operator()(std::size_t a, counted_t const& b) const noexcept { return a < b.key; }
+    bool operator()(counted_t const& a, std::size_t b) const noexcept { return a.key < b; }
+};
+
+TEST(layout, trivial_elements) {
+    {
+        auto avl = *consistent_avl_gt<counted_t, counted_compare_t>::make();
+        std::vector<counted_t> batch;
+        for (std::size_t idx = 0; idx < size; ++idx)
+            batch.emplace_back(idx);
+        EXPECT_TRUE(avl.upsert(batch.begin(), batch.end()));
+        EXPECT_TRUE(avl.upsert(batch.begin(), batch.end()));
+        for (std::size_t idx = 0; idx < size; idx += 2)
+            EXPECT_TRUE(avl.upsert(counted_t {idx}));
+
+        auto txn = *avl.transaction();
+        EXPECT_TRUE(txn.upsert(counted_t {size}));
+        EXPECT_TRUE(txn.erase(0));
+        EXPECT_TRUE(txn.stage());
+        EXPECT_TRUE(txn.commit());
+        batch.clear();
+        EXPECT_GE(counted_t::live, std::ptrdiff_t(size));
+        EXPECT_TRUE(avl.clear());
+    }
+    EXPECT_EQ(counted_t::live, 0);
+}
+
+struct varlen_tag_t {};
+
+TEST(layout, varlen) {
+    using bytes_allocator_t = counting_allocator_gt<std::allocator<char>, varlen_tag_t>;
+    using record_t = varlen_gt<16, bytes_allocator_t>;
+    auto& counters = bytes_allocator_t::counters();
+    std::string const long_key(40, 'k');
+    {
+        auto avl = *consistent_avl_gt<record_t, varlen_compare_t>::make();
+        EXPECT_TRUE(avl.upsert(record_t {"short", "value"}));
+        EXPECT_TRUE(avl.upsert(record_t {long_key, "spilled"}));
+        EXPECT_TRUE(avl.upsert(record_t {long_key + "!", "spilled"}));
+        // Only the records, that don't fit inline, allocate.
+        EXPECT_EQ(counters.total().allocations, 2u);
+
+        std::string value;
+        auto copy_value = [&](record_t const& record) noexcept { value = std::string(record.value()); };
+        EXPECT_TRUE(avl.find(std::string_view("short"), copy_value));
+        EXPECT_EQ(value, "value");
+        EXPECT_TRUE(avl.find(std::string_view(long_key), copy_value));
+        EXPECT_EQ(value, "spilled");
+
+        EXPECT_TRUE(avl.upsert(record_t {long_key, "overwritten"}));
+        EXPECT_TRUE(avl.find(std::string_view(long_key), copy_value));
+        EXPECT_EQ(value, "overwritten");
+
+        auto txn = *avl.transaction();
+        EXPECT_TRUE(txn.erase(std::string_view("short")));
+        EXPECT_TRUE(txn.stage());
+        EXPECT_TRUE(txn.commit());
+    }
+    EXPECT_EQ(counters.live_bytes(), 0u);
+
+    // Spilled bytes can share the arena with the nodes.
+    using arena_record_t = varlen_gt<16, arena_allocator_gt<char>>;
+    arena_t arena;
+    auto avl = *consistent_avl_gt<arena_record_t, varlen_compare_t, arena_allocator_gt<>>::make(arena);
+    for (std::size_t idx = 0; idx < size; ++idx)
+        EXPECT_TRUE(avl.upsert(arena_record_t {long_key + std::to_string(idx), "value", arena}));
+    std::size_t count = 0;
+    EXPECT_TRUE(avl.range(std::string_view(long_key), std::string_view(long_key + "a"), [&](auto const&) noexcept {
+        ++count;
+    }));
+    EXPECT_EQ(count, size);
+}
+
+TEST(layout, front_coded) {
+    using blocks_t = front_coded_gt<std::allocator<std::uint8_t>, no_tracer_t, 512, 8>;
+    using record_t = varlen_gt<16>;
+    auto blocks = *blocks_t::make();
+    auto avl = *consistent_avl_gt<record_t, varlen_compare_t>::make();
+
+    auto url = [](std::size_t idx) { return "https://example.com/catalog/items/" + std::to_string(idx * 7919 % 10007); };
+    std::vector<record_t> batch;
+    for (std::size_t idx = 0; idx < size * 8; ++idx)
+        batch.emplace_back(url(idx), std::to_string(idx));
+    EXPECT_TRUE(blocks.upsert(batch.begin(), batch.end()));
+    for (auto const& record : batch)
+        EXPECT_TRUE(avl.upsert(record_t {record}));
+    for (std::size_t idx = 0; idx < size; idx += 3) {
+        EXPECT_TRUE(blocks.upsert(varlen_view_t {url(idx), "overwritten"}));
+        EXPECT_TRUE(avl.upsert(record_t {url(idx), "overwritten"}));
+    }
+    EXPECT_TRUE(blocks.erase(url(1)));
+    EXPECT_TRUE(blocks.upsert(varlen_view_t {url(1) + "0", "new"}));
+    EXPECT_TRUE(avl.erase_range(url(1), url(1) + std::string(1, '\0')));
+    EXPECT_TRUE(avl.upsert(record_t {url(1) + "0", "new"}));
+    EXPECT_GT(blocks.blocks(), 1u);
+    EXPECT_EQ(blocks.size(), size * 8);
+
+    // Lookups of present and missing keys must match the AVL.
+    auto describe = [](std::string& out, auto record_type) {
+        using record_type_t = decltype(record_type);
+        return [&out](record_type_t const& record) noexcept {
+            out = std::string(record.key()) + "=" + std::string(record.value());
+        };
+    };
+    for (std::size_t idx = 0; idx < size * 8 + 16; ++idx) {
+        for (std::string const& key : {url(idx), url(idx) + "~", std::string("https://")}) {
+            std::string expected, found;
+            EXPECT_TRUE(avl.find(std::string_view(key), describe(expected, record_t {})));
+            EXPECT_TRUE(blocks.find(std::string_view(key), describe(found, varlen_view_t {})));
+            EXPECT_EQ(found, expected);
+            expected.clear(), found.clear();
+            EXPECT_TRUE(avl.upper_bound(std::string_view(key), describe(expected, record_t {})));
+            EXPECT_TRUE(blocks.upper_bound(std::string_view(key), describe(found, varlen_view_t {})));
+            EXPECT_EQ(found, expected);
+        }
+    }
+
+    // Ranges are inclusive and sorted, while the AVL visits them in tree order.
+    std::string lower = url(0) + "2", upper = url(0) + "4";
+    std::vector<std::string> expected, found;
+    EXPECT_TRUE(avl.range(std::string_view(lower), std::string_view(upper), [&](record_t const& record) noexcept {
+        expected.emplace_back(record.key());
+    }));
+    EXPECT_TRUE(blocks.range(std::string_view(lower), std::string_view(upper), [&](varlen_view_t const& record) noexcept {
+        found.emplace_back(record.key());
+    }));
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(found, expected);
+    EXPECT_TRUE(std::is_sorted(found.begin(), found.end()));
+
+    std::size_t erased = 0;
+    EXPECT_TRUE(blocks.erase_range(std::string_view(lower), std::string_view(upper), [&](auto const&) noexcept {
+        ++erased;
+    }));
+    EXPECT_EQ(erased, std::size_t(std::count_if(expected.begin(), expected.end(), [&](auto& key) { return key < upper; })));
+    EXPECT_EQ(blocks.size(), size * 8 - erased);
+
+    // Shared prefixes are stored once per restart interval.
+    std::size_t raw_bytes = 0;
+    for (auto const& record : batch)
+        raw_bytes += record.key().size() + record.value().size();
+    EXPECT_LT(blocks.memory_usage() * 2, raw_bytes);
+}
+
+template <typename collection_at>
+void test_scan_filter() {
+    auto collection = *collection_at::make();
+    for (std::size_t idx = 0; idx < size * 4; ++idx)
+        EXPECT_TRUE(collection.upsert(pair_t {idx, idx * 7 % 101}));
+
+    columns_gt<std::size_t, std::size_t, double> columns;
+    auto as_double = [](pair_t const& pair) noexcept { return pair.value / 2.0; };
+    EXPECT_TRUE(columns.export_range(collection, std::size_t(16), std::size_t(size * 3), &pair_t::value, as_double));
+    EXPECT_GE(columns.size(), size * 3 - 16);
+
+    typename decltype(columns)::positions_t positions;
+    EXPECT_TRUE(columns.template scan_filter<0>(between_gt<std::size_t> {10, 20}, positions));
+    std::size_t expected = 0;
+    for (std::size_t row = 0; row != columns.size(); ++row) {
+        bool matches = columns.template column<0>()[row] >= 10 && columns.template column<0>()[row] <= 20;
+        expected += matches;
+        EXPECT_EQ(columns.template column<1>()[row], columns.template column<0>()[row] / 2.0);
+    }
+    EXPECT_EQ(positions.size(), expected);
+    EXPECT_TRUE(std::is_sorted(positions.begin(), positions.end()));
+    for (auto position : positions) {
+        std::size_t id = columns.identifiers()[position];
+        EXPECT_TRUE(id * 7 % 101 >= 10 && id * 7 % 101 <= 20);
+    }
+
+    positions.clear();
+    EXPECT_TRUE(columns.template scan_filter<1>(less_than_gt<double> {1.0}, positions));
+    for (auto position : positions)
+        EXPECT_LT(columns.template column<1>()[position], 1.0);
+
+    // Failing to copy a row reports the error, instead of terminating inside `range`.
+    auto failing = [](pair_t const& pair) {
+        if (pair.key == size)
+            throw std::bad_alloc();
+        return pair.value / 2.0;
+    };
+    auto status = columns.export_range(collection, std::size_t(0), std::size_t(size * 2), &pair_t::value, failing);
+    EXPECT_EQ(status.errc, out_of_memory_heap_k);
+    EXPECT_EQ(columns.size(), 0u);
+}
+
+TEST(layout, scan_filter) {
+    test_scan_filter<stl_t>();
+    test_scan_filter<avl_t>();
+}
+
+/// Shared mutex, that counts exclusive acquisitions.
+struct counted_mutex_t : public std::shared_mutex {
+    static inline std::atomic<std::size_t> exclusive {0};
+    void lock() { ++exclusive, std::shared_mutex::lock(); }
+    bool try_lock() { return std::shared_mutex::try_lock() && ++exclusive; }
+};
+
+template <typename collection_at>
+void test_lock_free_transactions() {
+    auto collection = *collection_at::make();
+    counted_mutex_t::exclusive = 0;
+
+    constexpr std::size_t threads_count = 4;
+    std::vector<std::vector<std::int64_t>> generations(threads_count);
+    std::vector<std::thread> threads;
+    for (std::size_t thread_idx = 0; thread_idx != threads_count; ++thread_idx)
+        threads.emplace_back([&, thread_idx] {
+            for (std::size_t idx = 0; idx != size; ++idx) {
+                auto txn = *collection.transaction();
+                generations[thread_idx].push_back(txn.generation());
+                EXPECT_TRUE(txn.upsert(pair_t {idx, idx}));
+                EXPECT_TRUE(txn.reset());
+                generations[thread_idx].push_back(txn.generation());
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ(counted_mutex_t::exclusive, 0u);
+
+    std::vector<std::int64_t> all;
+    for (auto const& thread_generations : generations)
+        all.insert(all.end(), thread_generations.begin(), thread_generations.end());
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(std::adjacent_find(all.begin(), all.end()), all.end());
+
+    // Staged transactions have entries in the container, so those still lock.
+    auto txn = *collection.transaction();
+    EXPECT_TRUE(txn.upsert(pair_t {1, 1}));
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.reset());
+    EXPECT_GT(counted_mutex_t::exclusive, 0u);
+    bool found = false;
+    EXPECT_TRUE(collection.find(1, [&](pair_t const&) noexcept { found = true; }));
+    EXPECT_FALSE(found);
+}
+
+TEST(transactions, lock_free_creation) {
+    test_lock_free_transactions<locked_gt<stl_t, counted_mutex_t>>();
+    test_lock_free_transactions<locked_gt<avl_t, counted_mutex_t>>();
+    test_lock_free_transactions<partitioned_gt<avl_t, std::hash<std::size_t>, counted_mutex_t>>();
+}
+
+TEST(transactions, hybrid_clock) {
+    using generation_t = hybrid_clock_t::generation_t;
+    constexpr std::size_t threads_count = 8;
+    constexpr std::size_t draws_k = 4096;
+    std::vector<std::vector<generation_t>> generations(threads_count * 2);
+    auto draw = [&](std::size_t thread_idx) {
+        for (std::size_t idx = 0; idx != draws_k; ++idx)
+            generations[thread_idx].push_back(hybrid_clock_t::next());
+    };
+
+    // Concurrent threads own different slots, while sequential ones reuse them.
+    std::vector<std::thread> threads;
+    for (std::size_t thread_idx = 0; thread_idx != threads_count; ++thread_idx)
+        threads.emplace_back(draw, thread_idx);
+    for (auto& thread : threads)
+        thread.join();
+    for (std::size_t thread_idx = threads_count; thread_idx != threads_count * 2; ++thread_idx)
+        std::thread(draw, thread_idx).join();
+
+    std::vector<generation_t> all;
+    for (auto const& thread_generations : generations) {
+        EXPECT_TRUE(std::is_sorted(thread_generations.begin(), thread_generations.end()));
+        all.insert(all.end(), thread_generations.begin(), thread_generations.end());
+    }
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(std::adjacent_find(all.begin(), all.end()), all.end());
+    EXPECT_LT(all.back(), generation_t(1) << 61);
+    generation_t const floor = all.back() + (generation_t(1) << 30);
+    EXPECT_GT(hybrid_clock_t::next(floor), floor);
+
+    // Generations of later transactions are larger, regardless of the part or the container.
+    auto partitioned = *partitioned_gt<avl_t>::make();
+    auto locked = *locked_gt<stl_t>::make();
+    auto first = *partitioned.transaction();
+    auto second = *locked.transaction();
+    auto third = *partitioned.transaction();
+    EXPECT_LT(first.generation(), second.generation());
+    EXPECT_LT(second.generation(), third.generation());
+}
+
+/**
+ * A thread, that drew many generations, stamps its writes with larger generations,
+ * than later writes from other threads. The later writes must still win.
+ */
+template <typename collection_at>
+void test_cross_thread_order() {
+    auto collection = *collection_at::make();
+    hybrid_clock_t::generation_t ahead = hybrid_clock_t::next();
+    std::thread([&] {
+        // Run the clock of this thread seconds ahead of the others.
+        auto seconds = hybrid_clock_t::generation_t(10'000'000) << hybrid_clock_t::slot_bits_k;
+        ahead = hybrid_clock_t::next(ahead + seconds);
+        EXPECT_TRUE(collection.upsert(pair_t {1, 111}));
+        EXPECT_TRUE(collection.upsert(pair_t {2, 111}));
+        std::vector<pair_t> batch {{3, 111}};
+        EXPECT_TRUE(collection.upsert(batch.begin(), batch.end()));
+    }).join();
+
+    // Transactions start above the writes of the thread, that ran ahead.
+    EXPECT_GT(collection.transaction()->generation(), ahead);
+    EXPECT_TRUE(collection.upsert(pair_t {1, 222}));
+    auto txn = *collection.transaction();
+    EXPECT_TRUE(txn.upsert(pair_t {2, 222}));
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+    std::vector<pair_t> batch {{3, 222}};
+    EXPECT_TRUE(collection.upsert(batch.begin(), batch.end()));
+
+    EXPECT_EQ(collection.size(), 3u);
+    for (std::size_t key = 1; key != 4; ++key) {
+        std::size_t value = 0;
+        EXPECT_TRUE(collection.find(key, [&](pair_t const& pair) noexcept { value = pair.value; }));
+        EXPECT_EQ(value, 222u);
+    }
+}
+
+TEST(transactions, cross_thread_order) {
+    test_cross_thread_order<stl_t>();
+    test_cross_thread_order<avl_t>();
+    test_cross_thread_order<partitioned_gt<avl_t>>();
+}
+
+template <typename collection_at>
+void test_read_only_transactions() {
+    auto collection = *collection_at::make();
+    for (std::size_t idx = 0; idx != size; ++idx)
+        EXPECT_TRUE(collection.upsert(pair_t {idx, idx}));
+
+    // Watching and finding never needs the exclusive lock.
+    counted_mutex_t::exclusive = 0;
+    auto txn = *collection.transaction();
+    for (std::size_t idx = 0; idx != size; idx += 8) {
+        EXPECT_TRUE(txn.watch(idx));
+        EXPECT_TRUE(txn.find(idx, [&](pair_t const& pair) noexcept { EXPECT_EQ(pair.value, idx); }));
+    }
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+    EXPECT_EQ(counted_mutex_t::exclusive, 0u);
+
+    // Unrelated modifications force a revalidation of every key, which still passes.
+    EXPECT_TRUE(txn.reset());
+    EXPECT_TRUE(txn.watch(8));
+    EXPECT_TRUE(collection.upsert(pair_t {9, 10}));
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+
+    // Modifications of the watched keys are still noticed.
+    EXPECT_TRUE(txn.reset());
+    EXPECT_TRUE(txn.watch(8));
+    EXPECT_TRUE(collection.upsert(pair_t {8, 9}));
+    EXPECT_EQ(txn.stage().errc, errc_t::consistency_k);
+
+    // Transactions with changes still take the exclusive lock.
+    EXPECT_TRUE(txn.reset());
+    EXPECT_TRUE(txn.upsert(pair_t {8, 10}));
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+    EXPECT_GT(counted_mutex_t::exclusive, 0u);
+}
+
+TEST(transactions, read_only) {
+    test_read_only_transactions<locked_gt<stl_t, counted_mutex_t>>();
+    test_read_only_transactions<locked_gt<avl_t, counted_mutex_t>>();
+    test_read_only_transactions<partitioned_gt<avl_t, std::hash<std::size_t>, counted_mutex_t>>();
+}
+
+template <typename collection_at>
+void test_find_and_watch() {
+    auto collection = *collection_at::make();
+    for (std::size_t idx = 0; idx != size; idx += 2)
+        EXPECT_TRUE(collection.upsert(pair_t {idx, idx}));
+
+    // Read-modify-write of a present and a missing key.
+    auto txn = *collection.transaction();
+    std::size_t value = 0;
+    bool missing = false;
+    EXPECT_TRUE(txn.find_and_watch(4, [&](pair_t const& pair) noexcept { value = pair.value; }));
+    EXPECT_TRUE(txn.find_and_watch(5, [](pair_t const&) noexcept { FAIL(); }, [&]() noexcept { missing = true; }));
+    EXPECT_EQ(value, 4u);
+    EXPECT_TRUE(missing);
+    EXPECT_TRUE(txn.upsert(pair_t {4, value + 1}));
+    EXPECT_TRUE(txn.upsert(pair_t {5, 1}));
+
+    // Own changes are served from the transaction.
+    EXPECT_TRUE(txn.find_and_watch(4, [&](pair_t const& pair) noexcept { value = pair.value; }));
+    EXPECT_EQ(value, 5u);
+
+    // Another writer invalidates the watch, taken together with the read.
+    EXPECT_TRUE(collection.upsert(pair_t {5, 2}));
+    EXPECT_EQ(txn.stage().errc, errc_t::consistency_k);
+
+    // The batched version reports every key, and watches them all.
+    EXPECT_TRUE(txn.reset());
+    std::vector<std::size_t> keys(size);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::size_t found_count = 0, missing_count = 0;
+    EXPECT_TRUE(txn.find_and_watch(
+        keys.begin(),
+        keys.end(),
+        [&](pair_t const&) noexcept { ++found_count; },
+        [&](std::size_t id) noexcept { missing_count += id % 2; }));
+    // Odd keys are missing, except for the 5th, added by the other writer.
+    EXPECT_EQ(found_count, size / 2 + 1);
+    EXPECT_EQ(missing_count, size / 2 - 1);
+    EXPECT_TRUE(collection.upsert(pair_t {size - 1, 0}));
+    EXPECT_EQ(txn.stage().errc, errc_t::consistency_k);
+}
+
+TEST(transactions, find_and_watch) {
+    test_find_and_watch<stl_t>();
+    test_find_and_watch<avl_t>();
+    test_find_and_watch<locked_gt<avl_t>>();
+    test_find_and_watch<partitioned_gt<avl_t>>();
+}
+
+template <typename collection_at>
+void test_compact_watches() {
+    using allocator_t = typename collection_at::allocator_t;
+    using watch_t = typename collection_at::watch_t;
+    static_assert(sizeof(watch_t) == sizeof(typename collection_at::generation_t));
+    constexpr std::size_t keys_k = 1 << 14;
+    auto collection = *collection_at::make();
+    for (std::size_t idx = 0; idx != keys_k; ++idx)
+        EXPECT_TRUE(collection.upsert(pair_t {idx, idx}));
+
+    auto txn = *collection.transaction();
+    for (std::size_t idx = 0; idx != keys_k; ++idx) {
+        EXPECT_TRUE(txn.watch(idx));
+        EXPECT_TRUE(txn.upsert(pair_t {idx, idx + 1}));
+    }
+
+    // Staging keeps just the keys of the changes, without repeating the watches.
+    allocator_t::counters().reset();
+    {
+        allocation_site_t _ {"stage"};
+        EXPECT_TRUE(txn.stage());
+    }
+    EXPECT_LE(allocator_t::counters().stats("stage").allocated_bytes, keys_k * sizeof(std::size_t));
+    EXPECT_TRUE(txn.commit());
+    EXPECT_EQ(collection.size(), keys_k);
+    EXPECT_TRUE(collection.find(keys_k - 1, [&](pair_t const& pair) noexcept { EXPECT_EQ(pair.value, keys_k); }));
+
+    // Another writer, touching a single watched key, still invalidates the whole transaction.
+    EXPECT_TRUE(txn.reset());
+    for (std::size_t idx = 0; idx != keys_k; ++idx)
+        EXPECT_TRUE(txn.watch(idx));
+    EXPECT_TRUE(txn.upsert(pair_t {0, 0}));
+    EXPECT_TRUE(collection.upsert(pair_t {keys_k / 2, 0}));
+    EXPECT_EQ(txn.stage().errc, consistency_k);
+}
+
+TEST(transactions, compact_watches) {
+    struct stl_tag_t {};
+    struct avl_tag_t {};
+    using stl_counting_t = counting_allocator_gt<std::allocator<std::uint8_t>, stl_tag_t>;
+    using avl_counting_t = counting_allocator_gt<std::allocator<std::uint8_t>, avl_tag_t>;
+    test_compact_watches<consistent_set_gt<pair_t, pair_compare_t, stl_counting_t>>();
+    test_compact_watches<consistent_avl_gt<pair_t, pair_compare_t, avl_counting_t>>();
+}
+
+struct counting_compare_t : public pair_compare_t {
+    static inline std::size_t calls = 0;
+    template <typename first_at, typename second_at>
+    bool operator()(first_at const& a, second_at const& b) const noexcept {
+        return ++calls, pair_compare_t::operator()(a, b);
+    }
+};
+
+TEST(test_set, hinted_batches) {
+    using counted_set_t = consistent_set_gt<pair_t, counting_compare_t>;
+    constexpr std::size_t existing_k = 1 << 14, batch_k = 1 << 10;
+    auto set = *counted_set_t::make();
+    std::vector<pair_t> evens(existing_k);
+    for (std::size_t idx = 0; idx != existing_k; ++idx)
+        evens[idx] = pair_t {idx * 2, 0};
+    EXPECT_TRUE(set.upsert(std::make_move_iterator(evens.begin()), std::make_move_iterator(evens.end())));
+
+    // A sorted batch, that interleaves with the existing keys and overwrites half of them.
+    std::vector<pair_t> batch(batch_k);
+    for (std::size_t idx = 0; idx != batch_k; ++idx)
+        batch[idx] = pair_t {existing_k + idx, 1};
+    counting_compare_t::calls = 0;
+    EXPECT_TRUE(set.upsert(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end())));
+    // Every element costs a few comparisons with its neighbors, instead of several descents.
+    std::size_t const depth = 64 - __builtin_clzll(existing_k);
+    EXPECT_LT(counting_compare_t::calls, batch_k * depth * 2);
+
+    EXPECT_EQ(set.size(), existing_k + batch_k / 2);
+    for (std::size_t key = 0; key != existing_k * 2; ++key) {
+        bool in_batch = key >= existing_k && key < existing_k + batch_k;
+        std::size_t expected = in_batch ? 1 : 0;
+        bool expected_found = in_batch || key % 2 == 0;
+        bool found = false;
+        EXPECT_TRUE(set.find(key, [&](pair_t const& pair) noexcept {
+            found = true;
+            EXPECT_EQ(pair.value, expected);
+        }));
+        EXPECT_EQ(found, expected_found);
+    }
+
+    // Transactions stage their changes through the same hinted path.
+    auto txn = *set.transaction();
+    for (std::size_t idx = 0; idx != batch_k; ++idx)
+        EXPECT_TRUE(txn.upsert(pair_t {idx, 2}));
+    EXPECT_TRUE(txn.stage());
+    EXPECT_TRUE(txn.commit());
+    EXPECT_TRUE(set.find(2, [](pair_t const& pair) noexcept { EXPECT_EQ(pair.value, 2u); }));
+    EXPECT_EQ(set.size(), existing_k + batch_k);
+}
+
+TEST(test_set, recycled_nodes) {
+    struct churn_tag_t {};
+    using churn_allocator_t = counting_allocator_gt<std::allocator<std::uint8_t>, churn_tag_t>;
+    using churn_set_t = consistent_set_gt<pair_t, pair_compare_t, churn_allocator_t>;
+    auto set = *churn_set_t::make();
+    auto txn = *set.transaction();
+    auto churn = [&](std::size_t round) {
+        for (std::size_t idx = 0; idx != size; ++idx)
+            EXPECT_TRUE(set.upsert(pair_t {idx, round}));
+        for (std::size_t idx = 0; idx != size / 4; ++idx) {
+            EXPECT_TRUE(txn.upsert(pair_t {idx, round}));
+            EXPECT_TRUE(txn.erase(size + idx));
+        }
+        EXPECT_TRUE(txn.reset());
+        std::vector<pair_t> batch(size / 4);
+        for (std::size_t idx = 0; idx != batch.size(); ++idx)
+            batch[idx] = pair_t {idx * 4, round};
+        EXPECT_TRUE(set.upsert(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end())));
+    };
+
+    // Once the pools are warm, overwrites and transaction resets reuse the released nodes.
+    churn(0);
+    churn(1);
+    churn_allocator_t::counters().reset();
+    {
+        allocation_site_t _ {"churn"};
+        for (std::size_t round = 2; round != 8; ++round)
+            churn(round);
+    }
+    EXPECT_EQ(churn_allocator_t::counters().stats("churn").allocations, 0u);
+    EXPECT_EQ(set.size(), size);
+    EXPECT_TRUE(set.find(4, [](pair_t const& pair) noexcept { EXPECT_EQ(pair.value, 7u); }));
+}
+
+/// Move-only element, owning its payload.
+struct unique_pair_t {
+    std::size_t key = 0;
+    std::unique_ptr<std::size_t> value;
+
+    unique_pair_t(std::size_t key = 0) noexcept : key(key) {}
+    unique_pair_t(std::size_t key, std::size_t value) : key(key), value(std::make_unique<std::size_t>(value)) {}
+    explicit operator std::size_t() const noexcept { return key; }
+    operator bool() const noexcept { return key != -1; }
+};
+
+struct unique_compare_t {
+    using value_type = std::size_t;
+    bool operator()(unique_pair_t const& a, unique_pair_t const& b) const noexcept { return a.key < b.key; }
+    bool operator()(std::size_t a, unique_pair_t const& b) const noexcept { return a < b.key; }
+    bool operator()(unique_pair_t const& a, std::size_t b) const noexcept { return a.key < b; }
+};
+
+template <typename collection_at>
+void test_move_only_batches() {
+    auto collection = *collection_at::make();
+    for (std::size_t round = 0; round != 2; ++round) {
+        std::vector<unique_pair_t> batch;
+        for (std::size_t idx = 0; idx != size; ++idx)
+            batch.emplace_back(idx, idx + round);
+        EXPECT_TRUE(collection.upsert(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end())));
+        // The payloads were moved into the collection, rather than copied.
+        for (auto const& moved : batch)
+            EXPECT_FALSE(moved.value);
+    }
+    EXPECT_EQ(collection.size(), size);
+    for (std::size_t idx = 0; idx != size; ++idx)
+        EXPECT_TRUE(collection.find(idx, [&](unique_pair_t const& pair) noexcept {
+            EXPECT_TRUE(pair.value);
+            EXPECT_EQ(*pair.value, idx + 1);
+        }));
+}
+
+TEST(layout, move_only_batches) {
+    using set_t = consistent_set_gt<unique_pair_t, unique_compare_t>;
+    using avl_t = consistent_avl_gt<unique_pair_t, unique_compare_t>;
+    test_move_only_batches<set_t>();
+    test_move_only_batches<avl_t>();
+    test_move_only_batches<locked_gt<avl_t>>();
+    test_move_only_batches<partitioned_gt<avl_t>>();
+}
+
+/// Element, sharing its payload, so that tests can observe, when the container releases it.
+struct shared_pair_t {
+    std::size_t key = 0;
+    std::shared_ptr<std::size_t> value;
+
+    shared_pair_t(std::size_t key = 0) noexcept : key(key) {}
+    shared_pair_t(std::size_t key, std::shared_ptr<std::size_t> value) noexcept : key(key), value(std::move(value)) {}
+    explicit operator std::size_t() const noexcept { return key; }
+    operator bool() const noexcept { return key != -1; }
+};
+
+struct shared_compare_t {
+    using value_type = std::size_t;
+    bool operator()(shared_pair_t const& a, shared_pair_t const& b) const noexcept { return a.key < b.key; }
+    bool operator()(std::size_t a, shared_pair_t const& b) const noexcept { return a < b.key; }
+    bool operator()(shared_pair_t const& a, std::size_t b) const noexcept { return a.key < b; }
+};
+
+TEST(test_set, recycled_payloads) {
+    auto set = *consistent_set_gt<shared_pair_t, shared_compare_t>::make();
+    auto payload = std::make_shared<std::size_t>(1);
+    for (std::size_t idx = 0; idx != size; ++idx)
+        EXPECT_TRUE(set.upsert(shared_pair_t {idx, payload}));
+    EXPECT_EQ(payload.use_count(), long(size + 1));
+
+    // Pooled nodes keep their storage, but not the elements, they used to hold.
+    for (std::size_t idx = 0; idx != size; ++idx)
+        EXPECT_TRUE(set.upsert(shared_pair_t {idx, nullptr}));
+    EXPECT_TRUE(set.erase_range(0, size, no_op_t {}));
+    EXPECT_EQ(payload.use_count(), 1);
+
+    auto txn = *set.transaction();
+    for (std::size_t idx = 0; idx != size; ++idx)
+        EXPECT_TRUE(txn.upsert(shared_pair_t {idx, payload}));
+    EXPECT_TRUE(txn.reset());
+    EXPECT_EQ(payload.use_count(), 1);
+}
+
+template <typename collection_at>
+void test_defragment(arena_t& arena) {
+    auto avl = *collection_at::make(arena);
+    std::vector<std::size_t> keys(size * 64);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937 {42});
+    for (std::size_t key : keys)
+        EXPECT_TRUE(avl.upsert(pair_t {key, key}));
+    std::size_t scattered = avl.neighbor_distance();
+
+    // Staged entries must stay in place, so that the transaction can still take them back.
+    auto txn = *avl.transaction();
+    EXPECT_TRUE(txn.upsert(pair_t {keys.size(), 0}));
+    EXPECT_TRUE(txn.stage());
+    for (std::size_t pass = 0; pass <= keys.size() / size; ++pass)
+        EXPECT_TRUE(avl.defragment(size));
+    EXPECT_TRUE(txn.rollback());
+    EXPECT_TRUE(txn.reset());
+    EXPECT_LT(avl.neighbor_distance(), scattered / 4);
+    EXPECT_EQ(avl.size(), keys.size());
+    for (std::size_t key : keys)
+        EXPECT_TRUE(avl.find(key, [&](pair_t const& pair) noexcept { EXPECT_EQ(pair.value, key); }));
+
+    // Slabs are carved from the reservation, and further passes don't move nodes, that are already in order.
+    EXPECT_LE(arena.mapped_bytes(), arena.config().contiguous_bytes);
+    std::vector<pair_t const*> addresses;
+    for (std::size_t key : keys)
+        EXPECT_TRUE(avl.find(key, [&](pair_t const& pair) noexcept { addresses.push_back(&pair); }));
+    EXPECT_TRUE(avl.defragment(keys.size() * 2));
+    for (std::size_t idx = 0; idx != keys.size(); ++idx)
+        EXPECT_TRUE(avl.find(keys[idx], [&](pair_t const& pair) noexcept { EXPECT_EQ(&pair, addresses[idx]); }));
+
+    // Survivors of mass deletions are evacuated from the sparse slabs, instead of pinning them.
+    for (std::size_t key : keys)
+        if (key % 4)
+            EXPECT_TRUE(avl.erase_range(key, key + 1, no_op_t {}));
+    std::size_t pinned = avl.memory_usage();
+    EXPECT_TRUE(avl.defragment(keys.size()));
+    EXPECT_LT(avl.memory_usage(), pinned / 2);
+    for (std::size_t key = 0; key < keys.size(); key += 4)
+        EXPECT_TRUE(avl.find(key, [&](pair_t const& pair) noexcept { EXPECT_EQ(pair.value, key); }));
+    EXPECT_TRUE(avl.clear());
+    txn.shrink_to_fit();
+    EXPECT_GT(avl.shrink_to_fit(), 0u);
+    EXPECT_EQ(avl.memory_usage(), 0u);
+}
+
+TEST(test_avl, defragment) {
+    arena_config_t config;
+    config.region_bytes = 1ul << 20;
+    config.contiguous_bytes = 1ul << 26;
+    arena_t arena {config}, offset_arena {config};
+    using arena_avl_t = consistent_avl_gt<pair_t, pair_compare_t, arena_allocator_gt<>>;
+    using offset_avl_t =
+        consistent_avl_gt<pair_t, pair_compare_t, arena_allocator_gt<>, no_tracer_t, compact_layout_t, offset_links_t>;
+    test_defragment<arena_avl_t>(arena);
+    test_defragment<offset_avl_t>(offset_arena);
+
+    auto locked = *locked_gt<avl_t>::make();
+    auto partitioned = *partitioned_gt<avl_t>::make();
+    for (std::size_t idx = 0; idx < size; ++idx) {
+        EXPECT_TRUE(locked.upsert(pair_t {idx, idx}));
+        EXPECT_TRUE(partitioned.upsert(pair_t {idx, idx}));
+    }
+    EXPECT_TRUE(locked.defragment(size));
+    EXPECT_TRUE(partitioned.defragment(size));
+    EXPECT_LE(locked.neighbor_distance(), sizeof(avl_t::entry_t) * 2);
+    EXPECT_LE(partitioned.neighbor_distance(), sizeof(avl_t::entry_t) * 2);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();